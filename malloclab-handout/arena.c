@@ -0,0 +1,183 @@
+/*
+ * arena.c - region (bump pointer) allocator built on the mm package.
+ *
+ * An arena is a list of chunks obtained from mm_malloc. Allocation bumps
+ * a pointer through the current chunk and moves on to a new chunk when
+ * the current one is full. Requests larger than a chunk get a chunk of
+ * their own. mm_arena_reset puts every regular chunk on the arena's
+ * spare list, so the next request cycle reuses them without going back
+ * to mm_malloc (and, through it, to mem_sbrk). Only oversized chunks
+ * are returned to the heap on reset.
+ *
+ * Chunks are whole pages registered in the page map, each as its own
+ * owner. mm_free of an arena block is therefore a harmless no-op (the
+ * block dies with the next reset), and mm_realloc can move a block out
+ * of an arena.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "mm.h"
+#include "pagemap.h"
+#include "config.h"
+
+/* Rounds size up to a multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* Rounds x up to a multiple of a (a must be a power of 2) */
+#define ROUNDUP(x, a) (((x) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+/* Header at the start of every chunk, padded to keep payloads aligned */
+typedef struct arena_chunk {
+    pm_owner_t owner;          /* page map owner of the chunk's pages */
+    struct arena_chunk *next;  /* next chunk in the used or spare list */
+    size_t size;               /* usable bytes following the header */
+} arena_chunk_t;
+
+#define CHUNK_HDR ALIGN(sizeof(arena_chunk_t))
+#define CHUNK_DATA(c) ((char *)(c) + CHUNK_HDR)
+
+struct mm_arena {
+    char *cur;              /* next free byte in the current chunk */
+    char *end;              /* first byte past the current chunk */
+    size_t chunk_size;      /* usable bytes in a regular chunk */
+    arena_chunk_t *used;    /* chunks handed out since the last reset */
+    arena_chunk_t *spare;   /* regular chunks kept across resets */
+};
+
+/*
+ * mm_arena_create - create an empty arena whose regular chunks hold
+ *     chunk_size bytes (ARENA_CHUNKSIZE if chunk_size is 0)
+ */
+mm_arena_t *mm_arena_create(size_t chunk_size)
+{
+    mm_arena_t *arena;
+
+    if ((arena = mm_malloc(sizeof(mm_arena_t))) == NULL)
+	return NULL;
+    chunk_size = chunk_size ? chunk_size : ARENA_CHUNKSIZE;
+    arena->chunk_size = ROUNDUP(CHUNK_HDR + chunk_size, PM_PAGESIZE) - CHUNK_HDR;
+    arena->cur = arena->end = NULL;
+    arena->used = arena->spare = NULL;
+    return arena;
+}
+
+/*
+ * chunk_free - page map callback for mm_free of an arena block. Arena
+ *     blocks are only released by mm_arena_reset, so there is nothing
+ *     to do.
+ */
+static void chunk_free(pm_owner_t *owner, void *p)
+{
+}
+
+/*
+ * chunk_usable_size - page map callback for mm_usable_size. Arena
+ *     blocks do not record their size, so this is the number of bytes
+ *     from p to the end of its chunk.
+ */
+static size_t chunk_usable_size(pm_owner_t *owner, void *p)
+{
+    arena_chunk_t *c = (arena_chunk_t *)owner;
+
+    return CHUNK_DATA(c) + c->size - (char *)p;
+}
+
+/*
+ * release_chunk - unregister chunk c and give it back to the heap
+ */
+static void release_chunk(arena_chunk_t *c)
+{
+    mm_pagemap_set(c, CHUNK_HDR + c->size, NULL);
+    mm_free(c);
+}
+
+/*
+ * new_chunk - make a chunk with at least size usable bytes the current
+ *     chunk of arena. Returns 0 if the heap is exhausted.
+ */
+static int new_chunk(mm_arena_t *arena, size_t size)
+{
+    arena_chunk_t *c;
+
+    if (size <= arena->chunk_size && arena->spare != NULL) {
+	c = arena->spare;
+	arena->spare = c->next;
+    }
+    else {
+	if (size < arena->chunk_size)
+	    size = arena->chunk_size;
+	size = ROUNDUP(CHUNK_HDR + size, PM_PAGESIZE);
+	if ((c = mm_memalign(PM_PAGESIZE, size)) == NULL)
+	    return 0;
+	c->owner.free = chunk_free;
+	c->owner.usable_size = chunk_usable_size;
+	c->size = size - CHUNK_HDR;
+	mm_pagemap_set(c, size, &c->owner);
+    }
+    c->next = arena->used;
+    arena->used = c;
+    arena->cur = CHUNK_DATA(c);
+    arena->end = arena->cur + c->size;
+    return 1;
+}
+
+/*
+ * mm_arena_alloc - allocate size bytes from arena. The block stays
+ *     valid until the next mm_arena_reset or mm_arena_destroy.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size)
+{
+    char *p;
+
+    /* ignore spurious requests */
+    if (size == 0)
+	return NULL;
+
+    size = ALIGN(size);
+    if ((size_t)(arena->end - arena->cur) < size) {
+	if (!new_chunk(arena, size))
+	    return NULL;
+    }
+    p = arena->cur;
+    arena->cur += size;
+    return p;
+}
+
+/*
+ * mm_arena_reset - release every block allocated from arena. Runs in
+ *     time proportional to the number of chunks, not blocks.
+ */
+void mm_arena_reset(mm_arena_t *arena)
+{
+    arena_chunk_t *c, *next;
+
+    for (c = arena->used; c != NULL; c = next) {
+	next = c->next;
+	if (c->size == arena->chunk_size) {
+	    c->next = arena->spare;
+	    arena->spare = c;
+	}
+	else
+	    release_chunk(c);
+    }
+    arena->used = NULL;
+    arena->cur = arena->end = NULL;
+}
+
+/*
+ * mm_arena_destroy - release arena and return all of its chunks to the
+ *     heap
+ */
+void mm_arena_destroy(mm_arena_t *arena)
+{
+    arena_chunk_t *c, *next;
+
+    mm_arena_reset(arena);
+    for (c = arena->spare; c != NULL; c = next) {
+	next = c->next;
+	release_chunk(c);
+    }
+    mm_free(arena);
+}
@@ -0,0 +1,17 @@
+/*
+ * arena.h - region (bump pointer) allocator built on the mm package.
+ *     Objects are carved out of chunks obtained with mm_malloc and are
+ *     never freed individually; mm_arena_reset releases all of them at
+ *     once.
+ */
+#include <stddef.h>
+
+/* Default number of bytes in each arena chunk */
+#define ARENA_CHUNKSIZE (16*(1<<10))
+
+typedef struct mm_arena mm_arena_t;
+
+mm_arena_t *mm_arena_create(size_t chunk_size);
+void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+void mm_arena_reset(mm_arena_t *arena);
+void mm_arena_destroy(mm_arena_t *arena);
@@ -10,7 +10,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/times.h>
+#include <time.h>
 #include "clock.h"
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 
 
 /******************************************************* 
@@ -21,7 +25,42 @@
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)  
+#if defined(__i386__) || defined(__x86_64__)
+/*
+ * read_tsc - read the 64 bit time stamp counter. rdtscp waits for all
+ * earlier instructions to finish, and the lfence keeps later ones
+ * from starting before the counter is read.
+ */
+static unsigned long long read_tsc(void)
+{
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp; lfence" 
+		 : "=a" (lo), "=d" (hi), "=c" (aux) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+#endif
+
+#if defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+static unsigned long long cyc_start = 0;
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = read_tsc();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(read_tsc() - cyc_start);
+}
+
+#elif defined(__i386__)  
 /*******************************************************
  * Pentium versions of start_counter() and get_counter()
  *******************************************************/
@@ -201,6 +240,79 @@ double mhz(int verbose)
     return mhz_full(verbose, 2);
 }
 
+#if defined(__i386__) || defined(__x86_64__)
+/* 
+ * tsc_calibrate - Estimate the TSC rate in MHz by counting the cycles
+ * in TSC_CALIBRATE_NS of the raw monotonic clock. Much faster than
+ * mhz(), and accurate to well under 0.1% once the TSC is invariant.
+ */
+#define TSC_CALIBRATE_NS 20000000.0  /* 20 ms */
+
+static double tsc_calibrate(void)
+{
+    struct timespec t0, t1;
+    unsigned long long c0, c1;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+    c0 = read_tsc();
+    do {
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    } while (ns < TSC_CALIBRATE_NS);
+    c1 = read_tsc();
+    return (c1 - c0) / (ns / 1e3);
+}
+
+/* 
+ * tsc_mhz - Return the rate of the invariant TSC in MHz. The CPU or
+ * the hypervisor usually publishes it through CPUID; otherwise it is
+ * measured with tsc_calibrate.
+ */
+double tsc_mhz(int verbose)
+{
+    unsigned a, b, c, d;
+    double rate = 0;
+    char *how = "CPUID";
+
+    /* Warn if the TSC rate follows the core clock */
+    if (__get_cpuid(0x80000007, &a, &b, &c, &d) && !(d & (1 << 8)))
+	printf("Warning: the TSC is not invariant, timings may drift\n");
+
+    /* Leaf 0x15: TSC rate = crystal rate * ebx/eax */
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+	__cpuid_count(0x15, 0, a, b, c, d);
+	if (a != 0 && b != 0 && c != 0)
+	    rate = (double)c * b / a / 1e6;
+    }
+
+    /* Hypervisors report the TSC rate in kHz at leaf 0x40000010 */
+    if (rate == 0 && __get_cpuid(1, &a, &b, &c, &d) && (c & (1u << 31))) {
+	__cpuid(0x40000000, a, b, c, d);
+	if (a >= 0x40000010) {
+	    __cpuid(0x40000010, a, b, c, d);
+	    rate = a / 1e3;
+	    how = "the hypervisor";
+	}
+    }
+
+    if (rate == 0) {
+	rate = tsc_calibrate();
+	how = "calibration";
+    }
+    if (verbose)
+	printf("TSC rate = %.1f MHz (from %s)\n", rate, how);
+    return rate;
+}
+#else
+double tsc_mhz(int verbose)
+{
+    printf("ERROR: There is no TSC on this platform.\n");
+    printf("Please choose another timing package in config.h.\n");
+    exit(1);
+}
+#endif
+
 /** Special counters that compensate for timer interrupt overhead */
 
 static double cyc_per_tick = 0.0;
@@ -15,6 +15,9 @@ double mhz(int verbose);
 /* Determine clock rate of processor, having more control over accuracy */
 double mhz_full(int verbose, int sleeptime);
 
+/* Rate of the invariant TSC in MHz, from CPUID or a quick calibration */
+double tsc_mhz(int verbose);
+
 /** Special counters that compensate for timer interrupt overhead */
 
 void start_comp_counter();
@@ -58,15 +58,87 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. This much address space is reserved up
+ * front, but pages are only committed as the heap grows.
  */
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#define MAX_HEAP (1<<30)  /* 1 GB */
+
+/*
+ * Granularity in bytes with which memlib commits heap pages as the brk
+ * advances, and decommits them when the heap is trimmed.
+ */
+#define COMMIT_CHUNK (64*(1<<10))  /* 64 KB */
+
+/*
+ * Set to "1" to back the heap with transparent huge pages. The heap is
+ * then aligned and committed in 2 MB units.
+ */
+#define MEM_USE_THP 0
+
+/*
+ * Streamed traces (mdriver -s) are read ahead in two buffers of
+ * STREAM_CHUNK requests each. Their id arrays start with room for
+ * STREAM_MIN_IDS ids and double whenever a larger id turns up.
+ */
+#define STREAM_CHUNK   (1<<16)
+#define STREAM_MIN_IDS 1024
+
+/*
+ * The robust runner (mdriver -R) replays each trace at least
+ * ROBUST_MIN_RUNS times, and then until the 95% confidence interval of
+ * the median run time is within ROBUST_CI of the median, giving up
+ * after ROBUST_MAX_RUNS runs or ROBUST_MAX_SECS seconds. Runs more than
+ * ROBUST_OUTLIER standard deviations (estimated from the median
+ * absolute deviation) from the median are ignored. Comparing against
+ * a baseline (-B) fails if the throughput or the utilization of a
+ * trace falls by more than ROBUST_REGRESSION of the baseline.
+ */
+#define ROBUST_MIN_RUNS   10
+#define ROBUST_MAX_RUNS   200
+#define ROBUST_MAX_SECS   10.0
+#define ROBUST_CI         0.01
+#define ROBUST_OUTLIER    3.0
+#define ROBUST_REGRESSION 0.05
+
+/*
+ * The libmm.so shim runs mm_malloc as the process allocator in a heap
+ * reserved with SHIM_HEAP bytes of address space, returning blocks
+ * aligned to SHIM_ALIGN bytes as the platform ABI requires of malloc.
+ * Requests of SHIM_MAX_REQUEST bytes or more fail with ENOMEM, since
+ * mem_sbrk and the block headers only hold 32 bit sizes.
+ */
+#define SHIM_HEAP        ((sizeof(void *) > 4) ? (1UL<<36) : (1UL<<30))
+#define SHIM_ALIGN       (2*sizeof(void *))
+#define SHIM_MAX_REQUEST (1UL<<30)
+
+/*
+ * The payload touch replay (mdriver -T) touches each block when it is
+ * allocated, and every TOUCH_PERIOD requests touches up to TOUCH_BLOCKS
+ * more ids picked at random, if they are live, to stand in for a
+ * program using its older objects. A touch reads and writes one byte
+ * in every TOUCH_LINE bytes of the chosen fraction of the payload.
+ */
+#define TOUCH_PERIOD 16
+#define TOUCH_BLOCKS 4
+#define TOUCH_LINE   64
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_TSC    1   /* pinned invariant TSC w/K-best scheme (x86 only) */
+
+/*
+ * Parameters of the K-best scheme used with USE_TSC: after TSC_WARMUPS
+ * untimed runs, a trace is replayed until its TSC_K fastest runs are
+ * within TSC_EPSILON of each other, or TSC_MAXSAMPLES runs have been
+ * made, and the fastest run is reported.
+ */
+#define TSC_K          3
+#define TSC_EPSILON    0.01
+#define TSC_MAXSAMPLES 20
+#define TSC_WARMUPS    1
 
 #endif /* __CONFIG_H */
@@ -22,6 +22,7 @@
 #define CLEAR_CACHE 0        /* Clear cache before running test function */
 #define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
 #define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define WARMUPS 0            /* Untimed runs before sampling */
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
@@ -30,6 +31,7 @@ static int compensate = COMPENSATE;
 static int clear_cache = CLEAR_CACHE;
 static int cache_bytes = CACHE_BYTES;
 static int cache_block = CACHE_BLOCK;
+static int warmups = WARMUPS;
 
 static int *cache_buf = NULL;
 
@@ -129,6 +131,10 @@ static void clear()
 double fcyc(test_funct f, void *argp)
 {
     double result;
+    int i;
+
+    for (i = 0; i < warmups; i++)
+	f(argp);
     init_sampler();
     if (compensate) {
 	do {
@@ -245,7 +251,12 @@ void set_fcyc_epsilon(double epsilon_arg)
     epsilon = epsilon_arg;
 }
 
-
-
-
-
+/* 
+ * set_fcyc_warmups - Number of untimed runs of the test function
+ *     before sampling starts
+ *     Default = 0
+ */
+void set_fcyc_warmups(int warmups_arg)
+{
+    warmups = warmups_arg;
+}
@@ -63,6 +63,13 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
+/* 
+ * set_fcyc_warmups - Number of untimed runs of the test function
+ *     before sampling starts
+ *     Default = 0
+ */
+void set_fcyc_warmups(int warmups_arg);
+
 
 
 
@@ -1,7 +1,9 @@
 /****************************
  * High-level timing wrappers
  ****************************/
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <sched.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -30,6 +32,18 @@ void init_fsecs(void)
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
+#elif USE_TSC
+    if (verbose)
+	printf("Measuring performance with the TSC.\n");
+
+    /* set key parameters for the fcyc package */
+    set_fcyc_maxsamples(TSC_MAXSAMPLES);
+    set_fcyc_clear_cache(0);
+    set_fcyc_compensate(0);
+    set_fcyc_epsilon(TSC_EPSILON);
+    set_fcyc_k(TSC_K);
+    set_fcyc_warmups(TSC_WARMUPS);
+    Mhz = tsc_mhz(verbose > 0);
 #elif USE_ITIMER
     if (verbose)
 	printf("Measuring performance with the interval timer.\n");
@@ -39,6 +53,35 @@ void init_fsecs(void)
 #endif
 }
 
+#if USE_TSC
+/*
+ * tsc_fcyc - Run fcyc pinned to the CPU we are on, so that every
+ *     sample sees the same core and its caches. The caller's CPU
+ *     affinity is restored afterwards.
+ */
+static double tsc_fcyc(fsecs_test_funct f, void *argp)
+{
+    double cycles;
+#ifdef __linux__
+    cpu_set_t saved, one;
+    int pinned = 0;
+    int cpu = sched_getcpu();
+
+    if (cpu >= 0 && sched_getaffinity(0, sizeof(saved), &saved) == 0) {
+	CPU_ZERO(&one);
+	CPU_SET(cpu, &one);
+	pinned = (sched_setaffinity(0, sizeof(one), &one) == 0);
+    }
+    cycles = fcyc(f, argp);
+    if (pinned)
+	sched_setaffinity(0, sizeof(saved), &saved);
+#else
+    cycles = fcyc(f, argp);
+#endif
+    return cycles;
+}
+#endif
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
@@ -47,6 +90,8 @@ double fsecs(fsecs_test_funct f, void *argp)
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
+#elif USE_TSC
+    return tsc_fcyc(f, argp)/(Mhz*1e6);
 #elif USE_ITIMER
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
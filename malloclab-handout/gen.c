@@ -0,0 +1,313 @@
+/*
+ * gen.c - synthetic traces generated from a declarative spec.
+ *
+ * Each request goes, in this order of priority, to
+ *   - a realloc of a random live block, if one request more than the
+ *     live blocks is left, so that an odd number of requests can end
+ *     with no block live either;
+ *   - freeing every live block, once there are only enough requests
+ *     left to do so (the traces are balanced, like the -bal ones);
+ *   - freeing the live block whose lifetime ran out first, if any did;
+ *   - a malloc, during the first burst_len requests of every
+ *     burst_every;
+ *   - freeing the block that would die next, if there are already
+ *     live blocks (unless live is 0);
+ *   - a realloc of a random live block, with probability realloc_p;
+ *   - a malloc of a block that lives for a lifetime drawn from life.
+ * The live blocks are kept in a heap ordered by the request at which
+ * they die. Every malloc gets a new id, so the trace has as many ids
+ * as mallocs.
+ *
+ * If the spec has a gap, every request is then given the time since
+ * the previous one, drawn from it, and the trace is timed.
+ *
+ * The random numbers come from splitmix64 rather than rand(), so a
+ * spec generates the same trace with any C library.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gen.h"
+
+/* Sizes are clamped to 1..MAX_SIZE bytes */
+#define MAX_SIZE (1 << 24)
+
+/* Gaps are clamped to 0..MAX_GAP ns */
+#define MAX_GAP 4000000000.0
+
+/* A live block, keyed by the request at which it dies */
+typedef struct {
+    long death;
+    int id;
+} live_t;
+
+/*
+ * next_rand - the next 64 random bits of the splitmix64 sequence
+ */
+static unsigned long long next_rand(unsigned long long *state)
+{
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * next_unit - a random double in [0,1)
+ */
+static double next_unit(unsigned long long *state)
+{
+    return (next_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * sample - draw a value from the distribution d
+ */
+static double sample(const gen_dist_t *d, unsigned long long *state)
+{
+    double u = next_unit(state), la, ha;
+
+    switch (d->kind) {
+    case GEN_UNIFORM:
+	return d->a + u * (d->b - d->a);
+    case GEN_EXP:
+	return -d->a * log(1 - u);
+    case GEN_POW:
+	/* inverse of the CDF of the Pareto law cut to [a,b] */
+	la = pow(d->a, d->c);
+	ha = pow(d->b, d->c);
+	return pow(-(u * ha - u * la - ha) / (ha * la), -1 / d->c);
+    case GEN_BIMODAL:
+	return (u < d->c) ? d->a : d->b;
+    default:
+	return d->a;
+    }
+}
+
+/*
+ * parse_dist - parse kind:a[:b[:c]] into d. Returns 0 on success and
+ *     -1 on error.
+ */
+static int parse_dist(char *s, gen_dist_t *d)
+{
+    static const struct {
+	char *name;
+	int kind, nargs;
+    } kinds[] = {
+	{"fixed", GEN_FIXED, 1}, {"uniform", GEN_UNIFORM, 2},
+	{"exp", GEN_EXP, 1}, {"pow", GEN_POW, 3}, {"bimodal", GEN_BIMODAL, 3}
+    };
+    char *colon = strchr(s, ':');
+    int i, n;
+
+    if (colon == NULL)
+	return -1;
+    *colon = '\0';
+    for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+	if (!strcmp(s, kinds[i].name))
+	    break;
+    *colon = ':';
+    if (i == sizeof(kinds) / sizeof(kinds[0]))
+	return -1;
+    d->kind = kinds[i].kind;
+    d->a = d->b = d->c = 0;
+    n = sscanf(colon + 1, "%lf:%lf:%lf", &d->a, &d->b, &d->c);
+    if (n != kinds[i].nargs || d->a < 0 || d->b < 0)
+	return -1;
+    if (d->kind == GEN_POW && (d->a <= 0 || d->b <= d->a || d->c <= 0))
+	return -1;
+    return 0;
+}
+
+/*
+ * gen_parse - parse spec into g, filling in the defaults of the keys
+ *     it leaves out. Returns 0 on success, or -1 with the reason in
+ *     err on error.
+ */
+int gen_parse(const char *spec, gen_spec_t *g, char *err, size_t errlen)
+{
+    char *copy, *key, *val, *save = NULL;
+    int rc = 0;
+
+    g->ops = 20000;
+    g->live = 0;
+    g->size.kind = GEN_POW;
+    g->size.a = 8;
+    g->size.b = 4096;
+    g->size.c = 1.2;
+    g->life.kind = GEN_EXP;
+    g->life.a = 1000;
+    g->realloc_p = 0;
+    g->grow = 1.5;
+    g->burst_every = g->burst_len = 0;
+    g->gap.kind = GEN_FIXED;
+    g->gap.a = g->gap.b = g->gap.c = 0;
+    g->seed = 1;
+
+    if ((copy = strdup(spec)) == NULL) {
+	snprintf(err, errlen, "out of memory");
+	return -1;
+    }
+    for (key = strtok_r(copy, ",", &save); key != NULL && rc == 0;
+	 key = strtok_r(NULL, ",", &save)) {
+	if ((val = strchr(key, '=')) == NULL) {
+	    snprintf(err, errlen, "%s is not key=value", key);
+	    rc = -1;
+	    break;
+	}
+	*val++ = '\0';
+	if (!strcmp(key, "ops"))
+	    rc = ((g->ops = atoi(val)) > 1) ? 0 : -1;
+	else if (!strcmp(key, "live"))
+	    rc = ((g->live = atoi(val)) >= 0) ? 0 : -1;
+	else if (!strcmp(key, "size"))
+	    rc = parse_dist(val, &g->size);
+	else if (!strcmp(key, "life"))
+	    rc = parse_dist(val, &g->life);
+	else if (!strcmp(key, "realloc"))
+	    rc = ((g->realloc_p = atof(val)) >= 0 && g->realloc_p <= 1) ? 0 : -1;
+	else if (!strcmp(key, "grow"))
+	    rc = ((g->grow = atof(val)) > 0) ? 0 : -1;
+	else if (!strcmp(key, "burst"))
+	    rc = (sscanf(val, "%d:%d", &g->burst_every, &g->burst_len) == 2 &&
+		  g->burst_len >= 0 && g->burst_len <= g->burst_every) ? 0 : -1;
+	else if (!strcmp(key, "gap"))
+	    rc = parse_dist(val, &g->gap);
+	else if (!strcmp(key, "seed"))
+	    g->seed = strtoul(val, NULL, 0);
+	else {
+	    snprintf(err, errlen, "unknown key %s", key);
+	    rc = -1;
+	    break;
+	}
+	if (rc < 0)
+	    snprintf(err, errlen, "bad value %s for %s", val, key);
+    }
+    free(copy);
+    return rc;
+}
+
+/*
+ * heap_push - add b to the heap of n live blocks
+ */
+static void heap_push(live_t *heap, int n, live_t b)
+{
+    int parent;
+
+    while (n > 0 && heap[parent = (n - 1) / 2].death > b.death) {
+	heap[n] = heap[parent];
+	n = parent;
+    }
+    heap[n] = b;
+}
+
+/*
+ * heap_pop - remove and return the first block to die from the heap
+ *     of n > 0 live blocks
+ */
+static live_t heap_pop(live_t *heap, int n)
+{
+    live_t top = heap[0], last = heap[--n];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < n) {
+	if (child + 1 < n && heap[child + 1].death < heap[child].death)
+	    child++;
+	if (heap[child].death >= last.death)
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/*
+ * clamp_size - round a sampled size to a valid request size
+ */
+static int clamp_size(double size)
+{
+    if (size < 1)
+	return 1;
+    if (size > MAX_SIZE)
+	return MAX_SIZE;
+    return (int)(size + 0.5);
+}
+
+/*
+ * gen_ops - generate the requests of g into a new array of g->ops
+ *     requests, and describe them in hdr. Returns NULL if out of memory.
+ */
+traceop_t *gen_ops(const gen_spec_t *g, tf_header_t *hdr)
+{
+    unsigned long long state = g->seed;
+    traceop_t *ops, *op;
+    live_t *heap, b;
+    int *sizes;
+    int i, k, burst, n = 0, num_ids = 0;
+    int timed = (g->gap.kind != GEN_FIXED || g->gap.a > 0);
+    double life, gap;
+
+    ops = (traceop_t *)malloc(g->ops * sizeof(traceop_t));
+    heap = (live_t *)malloc(g->ops * sizeof(live_t));
+    sizes = (int *)malloc(g->ops * sizeof(int));
+    if (ops == NULL || heap == NULL || sizes == NULL) {
+	free(ops);
+	free(heap);
+	free(sizes);
+	return NULL;
+    }
+
+    for (i = 0; i < g->ops; i++) {
+	op = &ops[i];
+	burst = (g->burst_len > 0 && i % g->burst_every < g->burst_len);
+	if (n > 0 && g->ops - i != n + 1 &&
+	    (g->ops - i <= n || heap[0].death <= i ||
+	     (!burst && g->live > 0 && n >= g->live))) {
+	    /* a block dies */
+	    b = heap_pop(heap, n--);
+	    op->type = FREE;
+	    op->index = b.id;
+	    op->size = 0;
+	}
+	else if (n > 0 && (g->ops - i == n + 1 || 
+			   (!burst && next_unit(&state) < g->realloc_p))) {
+	    /* a random live block grows (or shrinks) */
+	    k = heap[next_rand(&state) % n].id;
+	    sizes[k] = clamp_size(sizes[k] * g->grow);
+	    op->type = REALLOC;
+	    op->index = k;
+	    op->size = sizes[k];
+	}
+	else {
+	    /* a new block is born */
+	    sizes[num_ids] = clamp_size(sample(&g->size, &state));
+	    if ((life = sample(&g->life, &state)) < 1)
+		life = 1;
+	    else if (life > g->ops)
+		life = g->ops;
+	    b.death = i + (long)life;
+	    b.id = num_ids;
+	    heap_push(heap, n++, b);
+	    op->type = ALLOC;
+	    op->index = num_ids;
+	    op->size = sizes[num_ids++];
+	}
+
+	op->gap = 0;
+	if (timed && (gap = sample(&g->gap, &state)) > 0)
+	    op->gap = (gap > MAX_GAP) ? (unsigned)MAX_GAP : (unsigned)(gap + 0.5);
+    }
+
+    hdr->sugg_heapsize = 0;
+    hdr->num_ids = num_ids;
+    hdr->num_ops = g->ops;
+    hdr->weight = 1;
+    hdr->flags = timed ? TF_FLAG_TIMED : 0;
+    free(heap);
+    free(sizes);
+    return ops;
+}
@@ -0,0 +1,44 @@
+/*
+ * gen.h - synthetic traces generated from a declarative spec. A spec
+ *     is a comma-separated list of key=value settings, for example
+ *
+ *         ops=100000,live=2000,size=pow:16:65536:1.5,life=exp:500
+ *
+ *     The same spec (including its seed) always generates the same
+ *     requests, on any machine.
+ */
+#include "tracefmt.h"
+
+#ifndef __GEN_H_
+#define __GEN_H_
+
+/* A distribution of sizes or lifetimes: kind:a[:b[:c]] in a spec */
+typedef struct {
+    enum {GEN_FIXED,     /* fixed:v, always v */
+	  GEN_UNIFORM,   /* uniform:lo:hi */
+	  GEN_EXP,       /* exp:mean, exponential */
+	  GEN_POW,       /* pow:lo:hi:alpha, power law (bounded Pareto) */
+	  GEN_BIMODAL}   /* bimodal:x:y:p, x with probability p, else y */
+	kind;
+    double a, b, c;
+} gen_dist_t;
+
+/* A parsed spec; the comments give the keys and their defaults */
+typedef struct {
+    int ops;             /* ops=20000: number of requests */
+    int live;            /* live=0: most live blocks, 0 for no limit */
+    gen_dist_t size;     /* size=pow:8:4096:1.2: bytes per malloc */
+    gen_dist_t life;     /* life=exp:1000: requests a block lives */
+    double realloc_p;    /* realloc=0: chance a request is a realloc */
+    double grow;         /* grow=1.5: factor a realloc grows a block by */
+    int burst_every;     /* burst=0:0: every so many requests... */
+    int burst_len;       /* ...this many mallocs in a row */
+    gen_dist_t gap;      /* gap=fixed:0: ns between arrivals, where
+			    fixed:0 leaves the trace untimed */
+    unsigned long seed;  /* seed=1 */
+} gen_spec_t;
+
+int gen_parse(const char *spec, gen_spec_t *g, char *err, size_t errlen);
+traceop_t *gen_ops(const gen_spec_t *g, tf_header_t *hdr);
+
+#endif /* __GEN_H_ */
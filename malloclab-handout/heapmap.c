@@ -0,0 +1,360 @@
+/*
+ * heapmap.c - offline analyzer for the heap snapshots written by
+ *     mm_dump_heap (see mm.h for the format). Prints a summary of the
+ *     heap, its fragmentation by address range, a histogram of the free
+ *     block sizes and an ASCII map of the heap, and optionally draws the
+ *     heap as a PPM image.
+ *
+ *     usage: heapmap [-r <ranges>] [-w <width>] [-p <file.ppm>] <snapshot>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+#define DEF_RANGES 16    /* address ranges in the fragmentation table */
+#define DEF_WIDTH  64    /* characters per line of the ASCII map */
+#define MAP_ROWS   16    /* lines of the ASCII map */
+#define PPM_WIDTH  512   /* pixels per line of the image */
+#define NUM_BUCKETS 32   /* power of 2 buckets of free block sizes */
+
+/* Blocks start at their header, one 4 byte word before the payload */
+#define BLOCK_START(b) ((b)->addr - 4)
+#define BLOCK_END(b)   ((b)->addr - 4 + (b)->size)
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* One block of the snapshot */
+typedef struct {
+    unsigned long long addr;  /* payload address */
+    unsigned int size;        /* block size, tags included */
+    unsigned int flags;       /* MM_SNAP_xxx */
+} block_t;
+
+/* The whole snapshot */
+typedef struct {
+    unsigned long long heap_lo;  /* first heap byte */
+    unsigned long long first;    /* payload address of the first block */
+    unsigned long long heap;     /* heap size in bytes */
+    block_t *blocks;
+    int n;
+} snap_t;
+
+/*
+ * unix_error - report a Unix-style error and exit
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * get_le - the n byte little-endian number at p
+ */
+static unsigned long long get_le(unsigned char *p, int n)
+{
+    unsigned long long val = 0;
+
+    while (n-- > 0)
+	val = (val << 8) | p[n];
+    return val;
+}
+
+/*
+ * read_snap - read the snapshot in path, exiting on a malformed file
+ */
+static void read_snap(char *path, snap_t *s)
+{
+    FILE *f;
+    unsigned char buf[MM_SNAP_HDRSIZE];
+    unsigned int word;
+    unsigned long long addr;
+    int max = 1024;
+
+    if ((f = fopen(path, "rb")) == NULL)
+	unix_error(path);
+    if (fread(buf, 1, MM_SNAP_HDRSIZE, f) != MM_SNAP_HDRSIZE ||
+	memcmp(buf, MM_SNAP_MAGIC, 8) != 0 ||
+	get_le(buf + 8, 4) != MM_SNAP_VERSION) {
+	fprintf(stderr, "%s: not a heap snapshot\n", path);
+	exit(1);
+    }
+    s->heap_lo = get_le(buf + 16, 8);
+    s->first = get_le(buf + 24, 8);
+    s->heap = get_le(buf + 32, 8);
+    s->n = 0;
+    if ((s->blocks = malloc(max * sizeof(block_t))) == NULL)
+	unix_error("malloc failed in read_snap");
+
+    for (addr = s->first; ; addr += word & ~0x7) {
+	if (fread(buf, 1, 4, f) != 4) {
+	    fprintf(stderr, "%s: truncated after %d blocks\n", path, s->n);
+	    exit(1);
+	}
+	if ((word = get_le(buf, 4)) == 0)
+	    break;
+	if (s->n == max) {
+	    max *= 2;
+	    if ((s->blocks = realloc(s->blocks, max * sizeof(block_t))) == NULL)
+		unix_error("realloc failed in read_snap");
+	}
+	s->blocks[s->n].addr = addr;
+	s->blocks[s->n].size = word & ~0x7;
+	s->blocks[s->n].flags = word & 0x7;
+	s->n++;
+    }
+    fclose(f);
+}
+
+/*
+ * print_summary - totals of the allocated and free blocks
+ */
+static void print_summary(snap_t *s)
+{
+    unsigned long long alloc = 0, owned = 0, free_bytes = 0, largest = 0;
+    int i, nalloc = 0, nfree = 0;
+
+    for (i = 0; i < s->n; i++) {
+	if (s->blocks[i].flags & MM_SNAP_ALLOC) {
+	    alloc += s->blocks[i].size;
+	    nalloc++;
+	    if (s->blocks[i].flags & MM_SNAP_OWNED)
+		owned += s->blocks[i].size;
+	}
+	else {
+	    free_bytes += s->blocks[i].size;
+	    nfree++;
+	    if (s->blocks[i].size > largest)
+		largest = s->blocks[i].size;
+	}
+    }
+    printf("Heap at 0x%llx, %llu bytes, %d blocks\n", s->heap_lo, s->heap,
+	   s->n);
+    printf("  allocated %12llu bytes in %d blocks (%llu in pools/arenas)\n",
+	   alloc, nalloc, owned);
+    printf("  free      %12llu bytes in %d blocks, largest %llu\n",
+	   free_bytes, nfree, largest);
+    printf("  external fragmentation (1 - largest/free) = %.1f%%\n\n",
+	   free_bytes ? 100.0 * (1.0 - (double)largest / free_bytes) : 0.0);
+}
+
+/*
+ * print_ranges - split the heap into nranges equal address ranges and
+ *     show how much of each is allocated and how broken up its free
+ *     space is. Blocks that straddle a boundary are split between the
+ *     ranges.
+ */
+static void print_ranges(snap_t *s, int nranges)
+{
+    unsigned long long span, lo, hi, b_lo, b_hi, base = s->heap_lo;
+    unsigned long long alloc, free_bytes, largest;
+    int r, i = 0, j, nfree;
+
+    span = (s->heap + nranges - 1) / nranges;
+    if (span == 0)
+	return;
+    printf("Fragmentation by address range:\n");
+    printf("%18s%12s%8s%8s%8s%12s\n", "start", "bytes", "alloc", "free",
+	   "holes", "largest");
+    for (r = 0; r < nranges; r++) {
+	lo = base + r * span;
+	hi = lo + span;
+	alloc = free_bytes = largest = 0;
+	nfree = 0;
+
+	while (i < s->n && BLOCK_END(&s->blocks[i]) <= lo)
+	    i++;
+	for (j = i; j < s->n && BLOCK_START(&s->blocks[j]) < hi; j++) {
+	    b_lo = MAX(BLOCK_START(&s->blocks[j]), lo);
+	    b_hi = MIN(BLOCK_END(&s->blocks[j]), hi);
+	    if (s->blocks[j].flags & MM_SNAP_ALLOC)
+		alloc += b_hi - b_lo;
+	    else {
+		free_bytes += b_hi - b_lo;
+		nfree++;
+		if (s->blocks[j].size > largest)
+		    largest = s->blocks[j].size;
+	    }
+	}
+	printf("%#18llx%12llu%7.1f%%%7.1f%%%8d%12llu\n", lo, span,
+	       100.0 * alloc / span, 100.0 * free_bytes / span, nfree,
+	       largest);
+    }
+    printf("\n");
+}
+
+/*
+ * print_histogram - count the free blocks in power of 2 size classes
+ */
+static void print_histogram(snap_t *s)
+{
+    int count[NUM_BUCKETS] = {0};
+    unsigned long long bytes[NUM_BUCKETS] = {0};
+    int i, b;
+
+    for (i = 0; i < s->n; i++) {
+	if (s->blocks[i].flags & MM_SNAP_ALLOC)
+	    continue;
+	for (b = 0; b < NUM_BUCKETS - 1 && (2UL << b) <= s->blocks[i].size; b++)
+	    ;
+	count[b]++;
+	bytes[b] += s->blocks[i].size;
+    }
+    printf("Free blocks by size:\n");
+    printf("%24s%10s%14s\n", "size", "blocks", "bytes");
+    for (b = 0; b < NUM_BUCKETS; b++)
+	if (count[b] > 0)
+	    printf("%11lu - %10lu%10d%14llu\n", 1UL << b, (2UL << b) - 1,
+		   count[b], bytes[b]);
+    printf("\n");
+}
+
+/*
+ * print_map - draw the heap as width x MAP_ROWS characters, each
+ *     covering an equal share of the heap: '#' if it is mostly
+ *     allocated, '+' if partly, '.' if free, 'P' for pool and arena pages
+ */
+static void print_map(snap_t *s, int width)
+{
+    unsigned long long cell, lo, hi, b_lo, b_hi, alloc, owned;
+    int c, i = 0, j, ncells = width * MAP_ROWS;
+
+    cell = (s->heap + ncells - 1) / ncells;
+    if (cell == 0)
+	return;
+    printf("Heap map, %llu bytes per character "
+	   "('#' allocated, '+' partly, '.' free, 'P' pool/arena):\n", cell);
+    for (c = 0; c < ncells; c++) {
+	lo = s->heap_lo + c * cell;
+	hi = lo + cell;
+	alloc = owned = 0;
+	while (i < s->n && BLOCK_END(&s->blocks[i]) <= lo)
+	    i++;
+	for (j = i; j < s->n && BLOCK_START(&s->blocks[j]) < hi; j++) {
+	    if (!(s->blocks[j].flags & MM_SNAP_ALLOC))
+		continue;
+	    b_lo = MAX(BLOCK_START(&s->blocks[j]), lo);
+	    b_hi = MIN(BLOCK_END(&s->blocks[j]), hi);
+	    alloc += b_hi - b_lo;
+	    if (s->blocks[j].flags & MM_SNAP_OWNED)
+		owned += b_hi - b_lo;
+	}
+	if (lo >= s->heap_lo + s->heap)
+	    putchar(' ');
+	else if (2 * owned > cell)
+	    putchar('P');
+	else if (4 * alloc >= 3 * cell)
+	    putchar('#');
+	else if (4 * alloc >= cell)
+	    putchar('+');
+	else
+	    putchar('.');
+	if (c % width == width - 1)
+	    putchar('\n');
+    }
+    printf("\n");
+}
+
+/*
+ * write_ppm - draw the heap as a PPM image PPM_WIDTH pixels wide, each
+ *     pixel colored after the block holding its first byte: allocated
+ *     blocks in alternating blues, so that neighbors can be told apart,
+ *     pool and arena pages in green and free blocks in white
+ */
+static void write_ppm(snap_t *s, char *path)
+{
+    static const unsigned char colors[4][3] = {
+	{40, 80, 200}, {90, 140, 240}, {60, 180, 80}, {255, 255, 255}
+    };
+    FILE *f;
+    unsigned long long px, addr;
+    int rows, x, y, i = 0, color;
+
+    px = (s->heap + (unsigned long long)PPM_WIDTH * PPM_WIDTH - 1) /
+	((unsigned long long)PPM_WIDTH * PPM_WIDTH);
+    px = (px + 7) & ~7ULL;
+    if (px == 0)
+	px = 8;
+    rows = (s->heap + PPM_WIDTH * px - 1) / (PPM_WIDTH * px);
+    if ((f = fopen(path, "wb")) == NULL)
+	unix_error(path);
+    fprintf(f, "P6\n%d %d\n255\n", PPM_WIDTH, rows);
+    for (y = 0; y < rows; y++)
+	for (x = 0; x < PPM_WIDTH; x++) {
+	    addr = s->heap_lo + (y * (unsigned long long)PPM_WIDTH + x) * px;
+	    while (i < s->n && BLOCK_END(&s->blocks[i]) <= addr)
+		i++;
+	    if (i == s->n || BLOCK_START(&s->blocks[i]) > addr)
+		fwrite("\0\0\0", 1, 3, f);  /* prologue, or past the heap */
+	    else {
+		if (!(s->blocks[i].flags & MM_SNAP_ALLOC))
+		    color = 3;
+		else if (s->blocks[i].flags & MM_SNAP_OWNED)
+		    color = 2;
+		else
+		    color = i & 1;
+		fwrite(colors[color], 1, 3, f);
+	    }
+	}
+    if (fclose(f) != 0)
+	unix_error(path);
+    printf("Wrote %s: %d x %d pixels, %llu bytes per pixel\n", path,
+	   PPM_WIDTH, rows, px);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: heapmap [-r <ranges>] [-w <width>] "
+	    "[-p <file.ppm>] <snapshot>\n");
+    fprintf(stderr, "\t-r <ranges>   Address ranges in the fragmentation table.\n");
+    fprintf(stderr, "\t-w <width>    Width of the ASCII map in characters.\n");
+    fprintf(stderr, "\t-p <file.ppm> Also draw the heap as a PPM image.\n");
+}
+
+int main(int argc, char **argv)
+{
+    snap_t s;
+    int c, nranges = DEF_RANGES, width = DEF_WIDTH;
+    char *ppm = NULL;
+
+    while ((c = getopt(argc, argv, "r:w:p:h")) != EOF) {
+	switch (c) {
+	case 'r':
+	    if ((nranges = atoi(optarg)) <= 0)
+		nranges = DEF_RANGES;
+	    break;
+	case 'w':
+	    if ((width = atoi(optarg)) <= 0)
+		width = DEF_WIDTH;
+	    break;
+	case 'p':
+	    ppm = optarg;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	usage();
+	exit(1);
+    }
+
+    read_snap(argv[optind], &s);
+    print_summary(&s);
+    print_ranges(&s, nranges);
+    print_histogram(&s);
+    print_map(&s, width);
+    if (ppm != NULL)
+	write_ppm(&s, ppm);
+    free(s.blocks);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * hist.c - log-linear latency histograms.
+ *
+ * A value v >= HIST_SUB with its highest set bit at position m falls in
+ * row m - HIST_SUB_BITS + 1, and its HIST_SUB_BITS bits below bit m
+ * select the bucket within the row. Row 0 holds the small values
+ * 0..HIST_SUB-1 one per bucket. Each row covers twice the range of the
+ * one before with the same number of buckets, so the relative error is
+ * constant while the histogram stays a fixed, small size.
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * bucket_of - the bucket that counts v
+ */
+static int bucket_of(unsigned long long v)
+{
+    int shift;
+
+    if (v < HIST_SUB)
+	return (int)v;
+    shift = (63 - __builtin_clzll(v)) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+/*
+ * bucket_max - the largest value counted by bucket i
+ */
+static unsigned long long bucket_max(int i)
+{
+    int shift;
+
+    if (i < HIST_SUB)
+	return i;
+    shift = i / HIST_SUB - 1;
+    return (((unsigned long long)(i % HIST_SUB + HIST_SUB) + 1) << shift) - 1;
+}
+
+/*
+ * hist_init - empty the histogram h
+ */
+void hist_init(hist_t *h)
+{
+    memset(h, 0, sizeof(hist_t));
+}
+
+/*
+ * hist_add - record the value v in h
+ */
+void hist_add(hist_t *h, unsigned long long v)
+{
+    h->counts[bucket_of(v)]++;
+    h->total++;
+    if (v > h->max)
+	h->max = v;
+}
+
+/*
+ * hist_percentile - an upper bound on the pct-th percentile (0 < pct
+ *     <= 100) of the values in h, or 0 if h is empty. The bound is the
+ *     top of the bucket holding the percentile, capped at the maximum.
+ */
+unsigned long long hist_percentile(const hist_t *h, double pct)
+{
+    unsigned long long rank, seen = 0, v;
+    int i;
+
+    if (h->total == 0)
+	return 0;
+    rank = (unsigned long long)(pct / 100.0 * h->total + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank)
+	    break;
+    }
+    v = bucket_max(i);
+    return (v < h->max) ? v : h->max;
+}
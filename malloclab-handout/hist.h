@@ -0,0 +1,26 @@
+/*
+ * hist.h - log-linear latency histograms. Values below HIST_SUB are
+ *     counted exactly; above that, every power of two is split into
+ *     HIST_SUB equal buckets, so any recorded value is known to within
+ *     1/HIST_SUB of itself.
+ */
+#ifndef __HIST_H_
+#define __HIST_H_
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+
+/* Enough buckets for any 64 bit value */
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;   /* number of recorded values */
+    unsigned long long max;     /* largest recorded value */
+} hist_t;
+
+void hist_init(hist_t *h);
+void hist_add(hist_t *h, unsigned long long v);
+unsigned long long hist_percentile(const hist_t *h, double pct);
+
+#endif /* __HIST_H_ */
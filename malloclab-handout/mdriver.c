@@ -10,15 +10,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "mm.h"
+#include "arena.h"
+#include "pool.h"
+#include "pagemap.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "tracefmt.h"
+#include "tstream.h"
+#include "hist.h"
+#include "perfctr.h"
+#include "robust.h"
+#include "gen.h"
 #include "config.h"
 
 /**********************
@@ -31,25 +49,65 @@
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
+
+/* Number of request types, for the per-type latency histograms */
+#define NUM_OPTYPES (ARENA_RESET + 1)
+
+/* Trace names that are generator specs (-G) rather than files */
+#define GEN_PREFIX "gen:"
+
+/* Results formats (--format) */
+#define FMT_TEXT 0
+#define FMT_JSON 1
+#define FMT_CSV  2
+
+/* getopt_long code of --format, outside the range of short options */
+#define OPT_FORMAT 256
+
+/* Identify the build in machine-readable results; set by the Makefile */
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS "unknown"
+#endif
+#ifndef BUILD_REV
+#define BUILD_REV "unknown"
+#endif
+
+/* Back-to-back timer reads used to calibrate the latency timer */
+#define LAT_CALIBRATE 10000
+
+/* An open-loop request issued this many ns after it arrived was late */
+#define OPEN_LATE 1000
+
+/* Bits per word of the shadow bitmap */
+#define SHADOW_WORDBITS (8 * sizeof(unsigned long))
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
-typedef struct range_t {
-    char *lo;              /* low payload address */
-    char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
-} range_t;
+/* 
+ * Shadow bitmap of the heap with one bit per ALIGNMENT-byte granule.
+ * A bit is set while its granule lies inside an allocated payload.
+ * Since payloads start on granule boundaries, two payloads overlap
+ * exactly when they share a granule.
+ */
+typedef struct {
+    unsigned long *bits;   /* the bitmap, reserved for all of MAX_HEAP */
+    char *base;            /* heap address of granule 0 */
+    size_t hi_word;        /* one past the highest word ever set */
+} shadow_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* 
+ * A request compiled for the timing passes: its id is resolved ahead
+ * of time to its slot in the trace's blocks array, so the replay loop
+ * neither decodes requests nor indexes by id (see compile_trace)
+ */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+    int type;            /* type of request, as in traceop_t */
+    int size;            /* byte size of alloc/realloc request */
+    char **slot;         /* where the request's block is kept */
+} codeop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
@@ -57,11 +115,33 @@ typedef struct {
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
+    traceop_t *ops;      /* array of requests (NULL for binary traces) */
+    unsigned char *map;  /* the mmap'd file of a binary trace... */
+    size_t map_len;      /* ... and its length in bytes */
+    tstream_t *stream;   /* the open file of a streamed trace (-s) */
+    int max_ids;         /* number of slots in the three id arrays */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    int uses_arena;      /* does the trace contain arena requests? */
+    int timed;           /* may its requests have gaps (TF_FLAG_TIMED)? */
+    int *arena_ids;      /* ids allocated from the arena since its reset */
+    int num_arena_live;  /* number of ids in arena_ids */
+    codeop_t *code;      /* the compiled requests (NULL for streamed traces) */
 } trace_t;
 
+/* 
+ * Iterates over the requests of a trace. Text traces hand out pointers
+ * into trace->ops; binary traces are decoded on the fly from the
+ * mapped file, so they are never copied into memory.
+ */
+typedef struct {
+    trace_t *trace;
+    int i;                     /* number of requests handed out */
+    const unsigned char *pos;  /* next encoded request (binary only) */
+    tf_state_t state;          /* decoder state (binary only) */
+    traceop_t op;              /* the last decoded request (binary only) */
+} cursor_t;
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -69,9 +149,45 @@ typedef struct {
  */
 typedef struct {
     trace_t *trace;  
-    range_t *ranges;
+    shadow_t *ranges;
+    perfctr_t *pc;   /* if set, count the replay with these counters */
+    double touch;    /* fraction of each payload to touch (-T) */
+    char *live;      /* which ids hold a block, for the touch replay */
 } speed_t;
 
+/* One sample of the heap taken during the utilization pass (-F) */
+typedef struct {
+    int op;              /* number of requests replayed before the sample */
+    size_t live;         /* payload bytes of the live blocks */
+    size_t heap;         /* size of the heap */
+    size_t internal;     /* bytes of the allocated blocks beyond payloads */
+    size_t external;     /* bytes of the free blocks */
+    size_t largest;      /* size of the largest free block */
+} frag_sample_t;
+
+/* The fragmentation timeline of one trace: a sample every few requests */
+typedef struct {
+    int every;           /* requests between samples */
+    int n;               /* number of samples taken */
+    int max;             /* room in s */
+    frag_sample_t *s;    /* the samples, in request order */
+} timeline_t;
+
+/* 
+ * Where the heap went at the peak of the live bytes (-u), each as a
+ * fraction of the peak heap size. The fractions and the utilization
+ * add up to 1.
+ */
+typedef struct {
+    int op;              /* number of requests replayed at the peak */
+    double tags;         /* headers and footers of the allocated blocks */
+    double padding;      /* rounding of the requests up to the alignment */
+    double slack;        /* remainders of blocks too small to split off */
+    double free;         /* free blocks, and the heap grown after the peak */
+    double other;        /* the rest: prologue, epilogue, pool and arena
+			    slack */
+} loss_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,20 +197,90 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    int sbrks;       /* mem_sbrk calls made on this trace */
+    hist_t *lat;     /* per request type latencies (-L), or NULL */
+    timeline_t tl;   /* fragmentation timeline (-F), with tl.n == 0 if none */
+    int accounted;   /* was the utilization loss broken down (-u)? */
+    loss_t loss;     /* the breakdown, if so */
+
+    /* defined only if the hardware counters were read (-P) */
+    int counted;        /* were the counters read on this trace? */
+    double ctr[PC_NUM]; /* counts per request, or -1 if unavailable */
+
+    /* defined only for the robust runner (-R); secs is then the median */
+    robust_t rob;
+
+    /* defined only for the payload touch replay (-T) */
+    double touch_secs;  /* time of the replay touching the payloads */
+
+    /* defined only if the replay overhead was measured (-I) */
+    double null_secs;   /* time of the replay on the null allocator */
+
+    /* defined only for the open-loop replay of a timed trace (-O) */
+    hist_t *open;       /* service [0] and response [1] times, or NULL */
+    double offered;     /* the rate the requests arrived at, in ops/sec */
+    double late;        /* fraction of the requests issued late */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* What to measure on each trace, as chosen on the command line */
+typedef struct {
+    int run_libc;        /* run libc malloc as well (-l) */
+    int latency;         /* measure per-request latencies (-L)... */
+    unsigned long long lat_overhead; /* ... less this timer cost in ns */
+    perfctr_t *pc;       /* read these hardware counters (-P), or NULL */
+    int frag_every;      /* sample the heap every so many requests (-F) */
+    int account;         /* break down the utilization loss (-u) */
+    double touch;        /* fraction of the payloads to touch (-T) */
+    int overhead;        /* time the replay on a null allocator (-I) */
+    double open;         /* replay timed traces open-loop, with their
+			    gaps scaled by this (-O), if set */
+} evalopts_t;
+
+/* 
+ * Several traces, the tenants, interleaved into one trace that runs on
+ * a single heap (-M). Each tenant keeps its requests in order, with
+ * its ids moved past those of the tenants before it.
+ */
+typedef struct {
+    int random;          /* pick each next tenant at random, by weight? */
+    double *weights;     /* the weights, or NULL to weigh each tenant by
+			    the requests it has left */
+    int n;               /* number of tenants */
+    trace_t *trace;      /* the interleaved requests */
+    int *tenant;         /* the tenant of each of its requests */
+    stats_t stats;       /* results for the mix as a whole... */
+    stats_t *tenants;    /* ... and for each tenant's share of it */
+} mix_t;
+
+/* Describes the machine and build behind a set of results */
+typedef struct {
+    char cpu[MAXLINE];   /* CPU model name */
+    int ncpus;           /* online CPUs */
+    char host[MAXLINE];  /* host name */
+    char date[MAXLINE];  /* local time of the run */
+    char *timer;         /* timing method selected in config.h */
+} meta_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int streaming = 0; /* stream traces from disk instead of loading them */
+static int robust = 0;    /* time traces with the robust runner (-R) */
+static int *dump_ops = NULL; /* snapshot the heap after these requests (-D)... */
+static int num_dump_ops = 0; /* ... of which there are this many */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Names of the request types, indexed by traceop_t type */
+static char *opnames[NUM_OPTYPES] = 
+    {"malloc", "free", "realloc", "arena", "reset"};
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -105,28 +291,94 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate the shadow bitmap of payload ranges */
+static int add_range(shadow_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum);
-static void remove_range(range_t **ranges, char *lo);
-static void clear_ranges(range_t **ranges);
+static void remove_range(shadow_t *ranges, char *lo, int size);
+static void clear_ranges(shadow_t *ranges);
+static int check_fill(char *p, int size, int c);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
 static void free_trace(trace_t *trace);
+static trace_t **load_traces(char **tracefiles, int n);
+static void gen_trace(trace_t *trace, char *spec);
+static void compile_trace(trace_t *trace);
+static void prepare_trace(trace_t *trace);
+static void run_mm_ops(trace_t *trace, mm_arena_t *arena);
+static void run_libc_ops(trace_t *trace);
+static void start_ops(cursor_t *cur, trace_t *trace);
+static traceop_t *next_op(cursor_t *cur);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static void eval_null_speed(void *ptr);
+static void eval_mm_touch(void *ptr);
+static void eval_libc_touch(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_valid(trace_t *trace, int tracenum, shadow_t *ranges,
+			 timeline_t *tl, double *util, int *peak_op);
+static void eval_mm_loss(trace_t *trace, int peak_op, loss_t *loss);
+static void frag_sample(timeline_t *tl, int op, size_t live);
+static void dump_heap(int tracenum, int op);
+static void parse_dump_ops(char *list);
+static double timeline_summary(timeline_t *tl, frag_sample_t **worst);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, hist_t *lat, 
+			    unsigned long long overhead);
+static unsigned long long calibrate_latency(void);
+static void eval_mm_open(trace_t *trace, double scale, 
+			 unsigned long long overhead, stats_t *stats);
+
+/* The evaluation of each trace, in this process or in workers (-w) */
+static void eval_trace(trace_t *trace, int tracenum, evalopts_t *o,
+		       stats_t *libc_stats, stats_t *mm_stats);
+static void run_workers(trace_t **traces, int n, int workers, evalopts_t *o,
+			stats_t *libc_stats, stats_t *mm_stats);
+
+/* Several traces interleaved on one heap (-M) */
+static void parse_mix(char *policy, mix_t *mix);
+static void mix_traces(trace_t **traces, int n, mix_t *mix);
+static void eval_mix(mix_t *mix, int tracenum, unsigned long long overhead);
+static void free_mix(mix_t *mix);
+
+/* Multi-threaded replay and scaling measurement */
+static void run_scaling(trace_t **traces, int num_tracefiles, 
+			int max_threads, int use_mm);
+
+/* Builtin microbenchmarks */
+static void run_bench(char *name);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats, unsigned long long overhead);
+static void printopen(int n, stats_t *stats, double scale, 
+		      unsigned long long overhead);
+static void printcounters(int n, stats_t *stats);
+static void printrobust(int n, stats_t *stats);
+static void printtimeline(int n, stats_t *stats);
+static void printloss(int n, stats_t *stats);
+static void printtouch(int n, stats_t *libc_stats, stats_t *mm_stats,
+		       double touch);
+static void printoverhead(int n, stats_t *stats);
+static void printmix(mix_t *mix, stats_t *mm_stats);
+static void time_trace(fsecs_test_funct f, speed_t *params, stats_t *stats);
+static double touch_trace(fsecs_test_funct f, speed_t *params);
+static void write_baseline(char *path, char **tracefiles, int n, 
+			   stats_t *stats);
+static int check_baseline(char *path, char **tracefiles, int n, 
+			  stats_t *stats);
+static void print_json(FILE *f, char **tracefiles, int n, 
+		       stats_t *libc_stats, stats_t *mm_stats, mix_t *mix,
+		       int numcorrect, double perfindex);
+static void print_csv(FILE *f, char **tracefiles, int n, 
+		      stats_t *libc_stats, stats_t *mm_stats, mix_t *mix,
+		      int numcorrect, double perfindex);
+static void count_speed(fsecs_test_funct f, speed_t *params, 
+			perfctr_t *pc, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -138,18 +390,42 @@ static void app_error(char *msg);
 int main(int argc, char **argv)
 {
     int i;
-    char c;
+    int c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    trace_t **traces = NULL;   /* all the traces, loaded once */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    evalopts_t opts;           /* what to measure on each trace */
+    perfctr_t pc;              /* hardware counters, for -P */
+    gen_spec_t gen_spec;       /* a generator spec, checked as it is parsed */
+    mix_t mix;                 /* the traces interleaved on one heap, for -M */
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    char *bench = NULL;  /* If set, name of the microbenchmark to run (-b) */
+    int threads = 0;     /* If set, max threads of the scaling run (-j) */
+    int latency = 0;     /* If set, measure per-request latencies (-L) */
+    unsigned long long lat_overhead = 0; /* timer cost in ns, for -L */
+    int counters = 0;    /* If set, read the hardware counters (-P) */
+    int frag_every = 0;  /* If set, sample the heap every so many requests (-F) */
+    int account = 0;     /* If set, break down the utilization loss (-u) */
+    double touch = 0;    /* If set, fraction of the payloads to touch (-T) */
+    int overhead = 0;    /* If set, time the replay on a null allocator (-I) */
+    int workers = 1;     /* number of processes evaluating the traces (-w) */
+    int mixing = 0;      /* If set, also run the traces as one mix (-M) */
+    double open = 0;     /* If set, scale of the open-loop gaps (-O) */
+    int local = 0;       /* If set, the traces are in the curr dir (-f) */
+    char *baseline = NULL; /* If set, baseline to compare against (-B) */
+    char *new_baseline = NULL; /* If set, baseline to write (-W) */
+    int regressions = 0; /* number of traces slower than the baseline */
+    int format = FMT_TEXT; /* format of the results (--format) */
+    FILE *results = NULL;  /* where --format results go */
+    static struct option long_options[] = {
+	{"format", required_argument, NULL, OPT_FORMAT},
+	{NULL, 0, NULL, 0}
+    };
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,21 +434,68 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "b:B:D:f:F:G:j:M:O:t:T:w:W:hvVgaIlLPRsu",
+			    long_options, NULL)) != EOF) {
         switch (c) {
+	case OPT_FORMAT: /* --format=json|csv: machine-readable results */
+	    if (!strcmp(optarg, "json"))
+		format = FMT_JSON;
+	    else if (!strcmp(optarg, "csv"))
+		format = FMT_CSV;
+	    else if (strcmp(optarg, "text")) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'b': /* Run a builtin microbenchmark instead of the traces */
+	    bench = optarg;
+	    break;
+	case 'B': /* Compare the results with a baseline file */
+	    baseline = optarg;
+	    break;
+	case 'W': /* Write the results to a baseline file */
+	    new_baseline = optarg;
+	    break;
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
 	    break;
-        case 'f': /* Use one specific trace file only (relative to curr dir) */
-            num_tracefiles = 1;
-            if ((tracefiles = realloc(tracefiles, 2*sizeof(char *))) == NULL)
+        case 'f': /* Use a specific trace file (relative to curr dir) */
+            if ((tracefiles = realloc(tracefiles, 
+				      (num_tracefiles+2)*sizeof(char *))) == NULL)
 		unix_error("ERROR: realloc failed in main");
 	    strcpy(tracedir, "./"); 
-            tracefiles[0] = strdup(optarg);
-            tracefiles[1] = NULL;
+	    local = 1;
+            tracefiles[num_tracefiles++] = strdup(optarg);
+            tracefiles[num_tracefiles] = NULL;
             break;
+	case 'G': /* Add a trace generated from a spec */
+	    if (gen_parse(optarg, &gen_spec, msg, MAXLINE) < 0) {
+		fprintf(stderr, "Bad generator spec: %s\n", msg);
+		exit(1);
+	    }
+	    if ((tracefiles = realloc(tracefiles, 
+				      (num_tracefiles+2)*sizeof(char *))) == NULL ||
+		(tracefiles[num_tracefiles] = 
+		 malloc(strlen(GEN_PREFIX) + strlen(optarg) + 1)) == NULL)
+		unix_error("ERROR: realloc failed in main");
+	    strcpy(tracefiles[num_tracefiles], GEN_PREFIX);
+	    strcat(tracefiles[num_tracefiles++], optarg);
+	    tracefiles[num_tracefiles] = NULL;
+	    break;
+	case 'F': /* Sample the fragmentation every N requests */
+	    if ((frag_every = atoi(optarg)) <= 0)
+		app_error("-F needs a positive number of requests");
+	    break;
+	case 'T': /* Replay again, touching a fraction of each payload */
+	    touch = atof(optarg);
+	    if (touch <= 0 || touch > 1)
+		app_error("-T needs a fraction of the payload in (0,1]");
+	    break;
+	case 'D': /* Dump the heap after the listed requests */
+	    parse_dump_ops(optarg);
+	    break;
 	case 't': /* Directory where the traces are located */
-	    if (num_tracefiles == 1) /* ignore if -f already encountered */
+	    if (local) /* ignore if -f already encountered */
 		break;
 	    strcpy(tracedir, optarg);
 	    if (tracedir[strlen(tracedir)-1] != '/') 
@@ -181,9 +504,43 @@ int main(int argc, char **argv)
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
+	case 'j': /* Measure scaling on up to N threads (0 = all cores) */
+	    if ((threads = atoi(optarg)) <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	    break;
+	case 'M': /* Also run the traces interleaved on one heap */
+	    parse_mix(optarg, &mix);
+	    mixing = 1;
+	    break;
+	case 'O': /* Replay the timed traces open-loop, scaling the gaps */
+	    if ((open = atof(optarg)) <= 0)
+		app_error("-O needs a positive scale for the gaps");
+	    break;
+	case 'w': /* Evaluate the traces on N processes (0 = all cores) */
+	    if ((workers = atoi(optarg)) <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	    break;
+        case 'I': /* Time the replay itself, on a null allocator */
+            overhead = 1;
+            break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Measure the latency of each request */
+            latency = 1;
+            break;
+        case 'P': /* Read the hardware counters on each trace */
+            counters = 1;
+            break;
+        case 'R': /* Time with the robust runner */
+            robust = 1;
+            break;
+        case 's': /* Stream the traces instead of loading them */
+            streaming = 1;
+            break;
+        case 'u': /* Break down where the utilization is lost */
+            account = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -198,6 +555,28 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+    if (threads > 0 && streaming)
+	app_error("-j cannot be combined with -s");
+    if (touch > 0 && streaming)
+	app_error("-T cannot be combined with -s");
+    if (overhead && streaming)
+	app_error("-I cannot be combined with -s");
+    if (workers > 1 && streaming)
+	app_error("-w cannot be combined with -s");
+    if (mixing && streaming)
+	app_error("-M cannot be combined with -s");
+
+    /* 
+     * Machine-readable results get stdout to themselves; everything
+     * else we print goes to stderr instead
+     */
+    if (format != FMT_TEXT) {
+	fflush(stdout);
+	if ((i = dup(STDOUT_FILENO)) < 0 || 
+	    (results = fdopen(i, "w")) == NULL ||
+	    dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	    unix_error("Could not set up the results stream");
+    }
 	
     /* 
      * Check and print team info 
@@ -225,6 +604,16 @@ int main(int argc, char **argv)
 	    printf("Member 2 :%s:%s\n", team.name2, team.id2);
     }
 
+    /*
+     * Microbenchmarks replace the trace-driven evaluation entirely
+     */
+    if (bench != NULL) {
+	init_fsecs();
+	mem_init();
+	run_bench(bench);
+	exit(0);
+    }
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -238,73 +627,64 @@ int main(int argc, char **argv)
     /* Initialize the timing package */
     init_fsecs();
 
-    /*
-     * Optionally run and evaluate the libc malloc package 
-     */
-    if (run_libc) {
-	if (verbose > 1)
-	    printf("\nTesting libc malloc\n");
-	
-	/* Allocate libc stats array, with one stats_t struct per tracefile */
-	libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-	if (libc_stats == NULL)
-	    unix_error("libc_stats calloc in main failed");
-	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
-
-	/* Display the libc results in a compact table */
-	if (verbose) {
-	    printf("\nResults for libc malloc:\n");
-	    printresults(num_tracefiles, libc_stats);
-	}
+    /* Counters are a bonus: carry on without them if we may not use them */
+    if (counters && perfctr_open(&pc) == 0) {
+	printf("Hardware counters unavailable (perf_event_open: %s), "
+	       "ignoring -P\n", strerror(errno));
+	counters = 0;
     }
 
-    /*
-     * Always run and evaluate the student's mm package
-     */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
+    /* Allocate the stats arrays, with one stats_t struct per tracefile */
+    if (run_libc && 
+	(libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+	unix_error("libc_stats calloc in main failed");
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    if (latency || mixing || open > 0)
+	lat_overhead = calibrate_latency();
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+    /* 
+     * Evaluate libc (optionally) and the student's mm malloc package on
+     * each trace, loading every trace once for all the passes
+     */
+    opts.run_libc = run_libc;
+    opts.latency = latency;
+    opts.lat_overhead = lat_overhead;
+    opts.pc = counters ? &pc : NULL;
+    opts.frag_every = frag_every;
+    opts.account = account;
+    opts.touch = touch;
+    opts.overhead = overhead;
+    opts.open = open;
+    traces = load_traces(tracefiles, num_tracefiles);
+    if (workers > 1)
+	run_workers(traces, num_tracefiles, workers, &opts, libc_stats, 
+		    mm_stats);
+    else
+	for (i = 0; i < num_tracefiles; i++)
+	    eval_trace(traces[i], i, &opts, 
+		       libc_stats ? &libc_stats[i] : NULL, &mm_stats[i]);
+    if (mixing) {
+	mix_traces(traces, num_tracefiles, &mix);
+	eval_mix(&mix, num_tracefiles, lat_overhead);
+    }
+
+    /* Display the libc results in a compact table */
+    if (run_libc && verbose) {
+	printf("\nResults for libc malloc:\n");
+	printresults(num_tracefiles, libc_stats);
+	if (robust) {
+	    printf("\nRobust timing for libc malloc:\n");
+	    printrobust(num_tracefiles, libc_stats);
 	}
-	free_trace(trace);
+    }
+    if (run_libc && counters) {
+	printf("\nHardware counters per request for libc malloc:\n");
+	printcounters(num_tracefiles, libc_stats);
     }
 
     /* Display the mm results in a compact table */
@@ -313,6 +693,45 @@ int main(int argc, char **argv)
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
     }
+    if (robust) {
+	printf("Robust timing for mm malloc:\n");
+	printrobust(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (counters) {
+	printf("Hardware counters per request for mm malloc:\n");
+	printcounters(num_tracefiles, mm_stats);
+	printf("\n");
+	perfctr_close(&pc);
+    }
+    if (latency) {
+	printlatency(num_tracefiles, mm_stats, lat_overhead);
+	printf("\n");
+    }
+    if (open > 0) {
+	printopen(num_tracefiles, mm_stats, open, lat_overhead);
+	printf("\n");
+    }
+    if (frag_every) {
+	printtimeline(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (account) {
+	printloss(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (touch > 0) {
+	printtouch(num_tracefiles, libc_stats, mm_stats, touch);
+	printf("\n");
+    }
+    if (overhead) {
+	printoverhead(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (mixing) {
+	printmix(&mix, mm_stats);
+	printf("\n");
+    }
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -357,32 +776,124 @@ int main(int argc, char **argv)
 	printf("Terminated with %d errors\n", errors);
     }
 
+    /*
+     * Optionally measure how throughput scales with threads
+     */
+    if (threads > 0 && errors == 0) {
+	if (run_libc)
+	    run_scaling(traces, num_tracefiles, threads, 0);
+	run_scaling(traces, num_tracefiles, threads, 1);
+    }
+    for (i = 0; i < num_tracefiles; i++)
+	free_trace(traces[i]);
+    free(traces);
+
+    /*
+     * Optionally save the results, or gate them on a saved baseline
+     */
+    if (new_baseline != NULL && errors == 0)
+	write_baseline(new_baseline, tracefiles, num_tracefiles, mm_stats);
+    if (baseline != NULL && errors == 0) {
+	printf("\nComparison with baseline %s:\n", baseline);
+	regressions = check_baseline(baseline, tracefiles, num_tracefiles, 
+				     mm_stats);
+	if (regressions > 0)
+	    printf("%d traces regressed by more than %.0f%%\n", 
+		   regressions, ROBUST_REGRESSION * 100);
+    }
+    else if (baseline != NULL)
+	printf("\nNot compared with baseline %s: the package is incorrect\n",
+	       baseline);
+
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    if (format == FMT_JSON)
+	print_json(results, tracefiles, num_tracefiles, libc_stats, mm_stats,
+		   mixing ? &mix : NULL, numcorrect, perfindex);
+    else if (format == FMT_CSV)
+	print_csv(results, tracefiles, num_tracefiles, libc_stats, mm_stats,
+		  mixing ? &mix : NULL, numcorrect, perfindex);
+    if (results != NULL && fclose(results) != 0)
+	unix_error("Could not write the results");
+    if (mixing)
+	free_mix(&mix);
+
+    /* an incorrect package never passes the gate */
+    if (baseline != NULL && errors > 0)
+	exit(3);
+    exit(regressions > 0 ? 2 : 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the shadow bitmap, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * bitmap to detect any overlapping allocated blocks. Checking or
+ * updating a payload of size bytes costs O(size/ALIGNMENT) bits,
+ * examined a word at a time, independent of the number of blocks.
  ****************************************************************/
 
+/*
+ * shadow_mask - mask of the granules g0..g1 that fall in word w
+ */
+static unsigned long shadow_mask(size_t w, size_t g0, size_t g1)
+{
+    unsigned long mask = ~0UL;
+
+    if (w == g0 / SHADOW_WORDBITS)
+	mask &= ~0UL << (g0 % SHADOW_WORDBITS);
+    if (w == g1 / SHADOW_WORDBITS)
+	mask &= ~0UL >> (SHADOW_WORDBITS - 1 - g1 % SHADOW_WORDBITS);
+    return mask;
+}
+
+/*
+ * shadow_find - return the first granule in g0..g1 whose bit is set,
+ *     or -1 if there is none
+ */
+static long shadow_find(shadow_t *ranges, size_t g0, size_t g1)
+{
+    size_t w;
+    unsigned long bits;
+
+    for (w = g0 / SHADOW_WORDBITS; w <= g1 / SHADOW_WORDBITS; w++) {
+	if ((bits = ranges->bits[w] & shadow_mask(w, g0, g1)) != 0)
+	    return w * SHADOW_WORDBITS + __builtin_ctzl(bits);
+    }
+    return -1;
+}
+
+/*
+ * shadow_fill - set (if on) or clear the bits of granules g0..g1
+ */
+static void shadow_fill(shadow_t *ranges, size_t g0, size_t g1, int on)
+{
+    size_t w;
+
+    for (w = g0 / SHADOW_WORDBITS; w <= g1 / SHADOW_WORDBITS; w++) {
+	if (on)
+	    ranges->bits[w] |= shadow_mask(w, g0, g1);
+	else
+	    ranges->bits[w] &= ~shadow_mask(w, g0, g1);
+    }
+    if (on && w > ranges->hi_word)
+	ranges->hi_word = w;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we mark its granules in the shadow bitmap.
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(shadow_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    long g;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -405,62 +916,78 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    g = shadow_find(ranges, (lo - ranges->base) / ALIGNMENT, 
+		    (hi - ranges->base) / ALIGNMENT);
+    if (g >= 0) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload at %p\n",
+		lo, hi, ranges->base + g * ALIGNMENT);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
-    /* 
-     * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
-     */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
-    p->lo = lo;
-    p->hi = hi;
-    *ranges = p;
+    /* Everything looks OK, so remember the extent of this block */
+    shadow_fill(ranges, (lo - ranges->base) / ALIGNMENT, 
+		(hi - ranges->base) / ALIGNMENT, 1);
     return 1;
 }
 
 /* 
- * remove_range - Free the range record of block whose payload starts at lo 
+ * remove_range - Forget the extent of the size byte payload at lo
  */
-static void remove_range(range_t **ranges, char *lo)
+static void remove_range(shadow_t *ranges, char *lo, int size)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
+    shadow_fill(ranges, (lo - ranges->base) / ALIGNMENT, 
+		(lo + size - 1 - ranges->base) / ALIGNMENT, 0);
+}
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+/*
+ * clear_ranges - forget every payload of a trace. Also rebases the
+ *     bitmap on the current heap, reserving it on first use.
+ */
+static void clear_ranges(shadow_t *ranges)
+{
+    size_t bytes = MAX_HEAP / ALIGNMENT / 8;
+
+    if (ranges->bits == NULL) {
+	ranges->bits = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (ranges->bits == MAP_FAILED)
+	    unix_error("mmap error in clear_ranges");
     }
+    memset(ranges->bits, 0, ranges->hi_word * sizeof(unsigned long));
+    ranges->hi_word = 0;
+    ranges->base = (char *)mem_heap_lo();
 }
 
 /*
- * clear_ranges - free all of the range records for a trace 
+ * check_fill - Return true if the first size bytes at p all equal the
+ *     low byte of c. Differences are ORed together 16 bytes (or a word)
+ *     at a time, with no early exit, so the whole payload is checked
+ *     at vector speed.
  */
-static void clear_ranges(range_t **ranges)
+static int check_fill(char *p, int size, int c)
 {
-    range_t *p;
-    range_t *pnext;
+    unsigned long pattern = (~0UL / 0xFF) * (unsigned char)c;
+    unsigned long diff = 0, w;
+    int i = 0;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+#ifdef __SSE2__
+    __m128i vpattern = _mm_set1_epi8((char)c);
+    __m128i vdiff = _mm_setzero_si128();
+
+    for (; i + 16 <= size; i += 16)
+	vdiff = _mm_or_si128(vdiff, _mm_xor_si128(vpattern,
+			     _mm_loadu_si128((__m128i *)(p + i))));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(vdiff, _mm_setzero_si128())) != 0xFFFF)
+	return 0;
+#endif
+    for (; i + (int)sizeof(unsigned long) <= size; i += sizeof(unsigned long)) {
+	memcpy(&w, p + i, sizeof(unsigned long));
+	diff |= w ^ pattern;
     }
-    *ranges = NULL;
+    for (; i < size; i++)
+	diff |= (unsigned char)p[i] ^ (unsigned char)c;
+    return diff == 0;
 }
 
 
@@ -469,17 +996,148 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * map_binary_trace - map the binary trace at path into memory and fill
+ *     in the header fields of trace. The requests stay in the file.
+ */
+static void map_binary_trace(trace_t *trace, char *path)
+{
+    char err[MAXLINE];
+    int fd;
+    struct stat st;
+    tf_header_t hdr;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	snprintf(err, MAXLINE, "Could not open %s in read_trace", path);
+	unix_error(err);
+    }
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED) {
+	snprintf(err, MAXLINE, "Could not mmap %s in read_trace", path);
+	unix_error(err);
+    }
+    close(fd);
+    if (!tf_get_header(trace->map, trace->map_len, &hdr)) {
+	snprintf(err, MAXLINE, "Unsupported binary trace version in %s", path);
+	app_error(err);
+    }
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    trace->uses_arena = (hdr.flags & TF_FLAG_ARENA) != 0;
+    trace->timed = (hdr.flags & TF_FLAG_TIMED) != 0;
+    trace->ops = NULL;
+}
+
+/*
+ * read_text_trace - read the requests of the .rep file tracefile into
+ *     trace->ops
+ */
+static void read_text_trace(trace_t *trace, FILE *tracefile, char *path)
+{
+    tf_header_t hdr;
+    traceop_t *op;
+    int rc;
+    unsigned max_index = 0;
+    unsigned op_index;
+
+    tf_read_text_header(tracefile, &hdr);
+    trace->sugg_heapsize = hdr.sugg_heapsize; /* not used */
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;               /* not used */
+    trace->uses_arena = 0;
+    trace->timed = 0;
+    trace->map = NULL;
+    
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops = 
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    while (op_index < trace->num_ops &&
+	   (rc = tf_read_text_op(tracefile, op = &trace->ops[op_index])) != 0) {
+	if (rc < 0) {
+	    printf("Bogus request type in tracefile %s\n", path);
+	    exit(1);
+	}
+	if (op->type != FREE && op->type != ARENA_RESET)
+	    max_index = (op->index > max_index) ? op->index : max_index;
+	if (op->type == ARENA_ALLOC || op->type == ARENA_RESET)
+	    trace->uses_arena = 1;
+	if (op->gap > 0)
+	    trace->timed = 1;
+	op_index++;
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+}
+
+/*
+ * open_stream_trace - open the trace at path for streaming and fill in
+ *     the header fields of trace. The header's request and id counts
+ *     are optional: num_ops is counted during the first pass, and the
+ *     id arrays grow as larger ids turn up.
+ */
+static void open_stream_trace(trace_t *trace, char *path)
+{
+    tf_header_t hdr;
+    char err[MAXLINE];
+
+    if ((trace->stream = tstream_open(path, STREAM_CHUNK, &hdr)) == NULL) {
+	snprintf(err, MAXLINE, 
+		 "Could not open %s for streaming in read_trace", path);
+	app_error(err);
+    }
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    trace->uses_arena = (hdr.flags & TF_FLAG_ARENA) != 0;
+    trace->timed = (hdr.flags & TF_FLAG_TIMED) != 0;
+    trace->ops = NULL;
+    trace->map = NULL;
+}
+
+/*
+ * gen_trace - generate the requests of a synthetic trace (-G) from its
+ *     spec, in memory, instead of reading them from a file
+ */
+static void gen_trace(trace_t *trace, char *spec)
+{
+    gen_spec_t g;
+    tf_header_t hdr;
+    char err[MAXLINE];
+
+    if (gen_parse(spec, &g, err, MAXLINE) < 0)
+	app_error(err);   /* not for -G specs, which main checked */
+    if ((trace->ops = gen_ops(&g, &hdr)) == NULL)
+	unix_error("gen_ops failed in read_trace");
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    trace->uses_arena = 0;
+    trace->timed = (hdr.flags & TF_FLAG_TIMED) != 0;
+    trace->map = NULL;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory. Binary traces
+ *     (see tracefmt.h) are recognized by their magic string and mapped
+ *     rather than read. With -s, only the header is read and the
+ *     requests are streamed from the file on every pass.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    char path[MAXLINE], err[MAXLINE];
+    unsigned char magic[TF_HDRSIZE];
+    size_t len;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -491,102 +1149,345 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
+    trace->stream = NULL;
+    if (!strncmp(filename, GEN_PREFIX, strlen(GEN_PREFIX)))
+	gen_trace(trace, filename + strlen(GEN_PREFIX));
+    else if (streaming) 
+	open_stream_trace(trace, path);
+    else if ((tracefile = fopen(path, "r")) == NULL) {
+	snprintf(err, MAXLINE, "Could not open %s in read_trace", path);
+	unix_error(err);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
+    else {
+	len = fread(magic, 1, TF_HDRSIZE, tracefile);
+	if (tf_is_binary(magic, len)) {
+	    fclose(tracefile);
+	    map_binary_trace(trace, path);
+	}
+	else {
+	    rewind(tracefile);
+	    read_text_trace(trace, tracefile, path);
+	    fclose(tracefile);
+	}
+    }
+    prepare_trace(trace);
+    return trace;
+}
+
+/*
+ * prepare_trace - Allocate the id arrays of a trace whose requests
+ *     were just read, and compile them unless they are streamed
+ */
+static void prepare_trace(trace_t *trace)
+{
+    /* Streamed traces may not declare their ids, so start small */
+    trace->max_ids = trace->num_ids;
+    if (trace->stream != NULL && trace->max_ids < STREAM_MIN_IDS)
+	trace->max_ids = STREAM_MIN_IDS;
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
+	 (char **)malloc(trace->max_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in prepare_trace");
 
     /* ... along with the corresponding byte sizes of each block */
     if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+	 (size_t *)malloc(trace->max_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in prepare_trace");
+
+    /* ... and the ids that are currently allocated from the arena */
+    if ((trace->arena_ids = 
+	 (int *)malloc(trace->max_ids * sizeof(int))) == NULL)
+	unix_error("malloc 5 failed in prepare_trace");
+    trace->num_arena_live = 0;
+
+    /* The timing passes replay the compiled requests */
+    trace->code = NULL;
+    if (trace->stream == NULL)
+	compile_trace(trace);
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
+ * free_trace - Free the trace record and the four arrays it points
  *              to, all of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    free(trace->ops);         /* free the four arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
+    free(trace->arena_ids);
+    free(trace->code);
+    if (trace->map != NULL)   /* unmap a binary trace... */
+	munmap(trace->map, trace->map_len);
+    if (trace->stream != NULL) /* close a streamed one... */
+	tstream_close(trace->stream);
     free(trace);              /* and the trace record itself... */
 }
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
+/* Hands out the traces to the loading threads of load_traces */
+typedef struct {
+    char **tracefiles;
+    trace_t **traces;
+    int n;               /* number of traces */
+    int next;            /* the next one to load */
+} loader_t;
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * load_thread - load traces until there are none left. Several threads
+ *     can fail at once, so read_trace, and next_op as it compiles the
+ *     requests, format their errors into local buffers rather than the
+ *     global msg.
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static void *load_thread(void *ptr)
 {
-    int i, j;
-    int index;
-    int size;
-    int oldsize;
-    char *newp;
-    char *oldp;
-    char *p;
-    
-    /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
-    clear_ranges(ranges);
+    loader_t *l = (loader_t *)ptr;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&l->next, 1)) < l->n)
+	l->traces[i] = read_trace(tracedir, l->tracefiles[i]);
+    return NULL;
+}
+
+/*
+ * load_traces - Read the n traces in tracefiles, on up to one thread
+ *     per CPU, into an array of traces that serves every pass
+ */
+static trace_t **load_traces(char **tracefiles, int n)
+{
+    loader_t l;
+    pthread_t *tids;
+    int i, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nthreads > n)
+	nthreads = n;
+    l.tracefiles = tracefiles;
+    l.n = n;
+    l.next = 0;
+    if ((l.traces = (trace_t **)malloc(n * sizeof(trace_t *))) == NULL ||
+	(tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t))) == NULL)
+	unix_error("malloc failed in load_traces");
+    for (i = 1; i < nthreads; i++)
+	if (pthread_create(&tids[i], NULL, load_thread, &l) != 0)
+	    app_error("pthread_create failed in load_traces");
+    load_thread(&l);
+    for (i = 1; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+    return l.traces;
+}
+
+/*
+ * compile_trace - Translate the requests of a loaded trace into the
+ *     codeop_t array that the timing passes replay
+ */
+static void compile_trace(trace_t *trace)
+{
+    cursor_t cur;
+    traceop_t *op;
+    codeop_t *c;
+
+    if ((trace->code = (codeop_t *)
+	 malloc((trace->num_ops + 1) * sizeof(codeop_t))) == NULL)
+	unix_error("malloc failed in compile_trace");
+    c = trace->code;
+    start_ops(&cur, trace);
+    while ((op = next_op(&cur)) != NULL) {
+	c->type = op->type;
+	c->size = op->size;
+	c->slot = (op->type == ARENA_RESET) ? NULL : &trace->blocks[op->index];
+	c++;
+    }
+    c->type = -1;   /* the end of the requests */
+}
+
+/*
+ * start_ops - position cur at the first request of trace
+ */
+static void start_ops(cursor_t *cur, trace_t *trace)
+{
+    cur->trace = trace;
+    cur->i = 0;
+    cur->pos = (trace->map != NULL) ? trace->map + TF_HDRSIZE : NULL;
+    cur->state.index = 0;
+    cur->state.size = 0;
+    cur->state.timed = trace->timed;
+    if (trace->stream != NULL && tstream_rewind(trace->stream) < 0)
+	unix_error("Could not rewind a streamed trace in start_ops");
+}
+
+/*
+ * grow_ids - make room in the id arrays of a streamed trace for index
+ */
+static void grow_ids(trace_t *trace, int index)
+{
+    int n = 2 * trace->max_ids;
+
+    if (n <= index)
+	n = index + 1;
+    if ((trace->blocks = realloc(trace->blocks, n * sizeof(char *))) == NULL ||
+	(trace->block_sizes = 
+	 realloc(trace->block_sizes, n * sizeof(size_t))) == NULL ||
+	(trace->arena_ids = realloc(trace->arena_ids, n * sizeof(int))) == NULL)
+	unix_error("realloc failed in grow_ids");
+    trace->max_ids = n;
+}
+
+/*
+ * next_op - return the next request of the trace, or NULL after the
+ *     last one
+ */
+static traceop_t *next_op(cursor_t *cur)
+{
+    trace_t *trace = cur->trace;
+    traceop_t *op;
+    char err[MAXLINE];
+    int rc;
+
+    if (trace->stream != NULL) {
+	if ((rc = tstream_next(trace->stream, &op)) == 0) {
+	    trace->num_ops = cur->i;  /* now known for certain */
+	    return NULL;
+	}
+	if (rc < 0 || op->index < 0) {
+	    sprintf(err, "Malformed request %d in streamed trace", cur->i);
+	    app_error(err);
+	}
+	if (op->index >= trace->max_ids)
+	    grow_ids(trace, op->index);
+	cur->i++;
+	return op;
+    }
+
+    if (cur->i >= trace->num_ops)
+	return NULL;
+    if (trace->ops != NULL)
+	return &trace->ops[cur->i++];
+
+    cur->pos = tf_decode_op(cur->pos, trace->map + trace->map_len, 
+			    &cur->op, &cur->state);
+    if (cur->pos == NULL || (unsigned)cur->op.index >= (unsigned)trace->num_ids) {
+	sprintf(err, "Malformed request %d in binary trace", cur->i);
+	app_error(err);
+    }
+    cur->i++;
+    return &cur->op;
+}
+
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
+
+/*
+ * eval_trace - Evaluate libc (if libc_stats is not NULL) and the mm
+ *     package on one trace: a checked pass for correctness and
+ *     utilization, then the uninstrumented timing passes, then the
+ *     optional measurements in o
+ */
+static void eval_trace(trace_t *trace, int tracenum, evalopts_t *o,
+		       stats_t *libc_stats, stats_t *mm_stats)
+{
+    static shadow_t ranges = {NULL}; /* block extents, reused by each trace */
+    speed_t speed_params;
+    int peak_op, j;
+
+    speed_params.trace = trace;
+    speed_params.ranges = &ranges;
+    speed_params.pc = NULL;
+    speed_params.touch = o->touch;
+    speed_params.live = NULL;
+
+    if (libc_stats != NULL) {
+	if (verbose > 1)
+	    printf("Checking libc malloc for correctness, ");
+	libc_stats->valid = eval_libc_valid(trace, tracenum);
+	libc_stats->ops = trace->num_ops;
+	if (libc_stats->valid) {
+	    if (verbose > 1)
+		printf("and performance.\n");
+	    time_trace(eval_libc_speed, &speed_params, libc_stats);
+	    if (o->pc != NULL)
+		count_speed(eval_libc_speed, &speed_params, o->pc, libc_stats);
+	    if (o->touch > 0)
+		libc_stats->touch_secs = 
+		    touch_trace(eval_libc_touch, &speed_params);
+	}
+    }
+
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness and efficiency, ");
+    mm_stats->tl.every = o->frag_every;
+    mm_stats->valid = eval_mm_valid(trace, tracenum, &ranges, 
+				    o->frag_every ? &mm_stats->tl : NULL,
+				    &mm_stats->util, &peak_op);
+    mm_stats->ops = trace->num_ops;
+    if (!mm_stats->valid)
+	return;
+    mm_stats->sbrks = mem_sbrkcount();
+    if (o->account) {
+	eval_mm_loss(trace, peak_op, &mm_stats->loss);
+	mm_stats->accounted = 1;
+    }
+    if (verbose > 1)
+	printf("and performance.\n");
+    time_trace(eval_mm_speed, &speed_params, mm_stats);
+    if (o->pc != NULL)
+	count_speed(eval_mm_speed, &speed_params, o->pc, mm_stats);
+    if (o->touch > 0)
+	mm_stats->touch_secs = touch_trace(eval_mm_touch, &speed_params);
+    if (o->overhead)
+	mm_stats->null_secs = fsecs(eval_null_speed, &speed_params);
+    if (o->latency) {
+	if ((mm_stats->lat = (hist_t *)
+	     malloc(NUM_OPTYPES * sizeof(hist_t))) == NULL)
+	    unix_error("malloc of latency histograms failed in eval_trace");
+	for (j = 0; j < NUM_OPTYPES; j++)
+	    hist_init(&mm_stats->lat[j]);
+	eval_mm_latency(trace, mm_stats->lat, o->lat_overhead);
+    }
+    if (o->open > 0 && trace->timed)
+	eval_mm_open(trace, o->open, o->lat_overhead, mm_stats);
+}
+
+/*
+ * eval_mm_valid - Check the mm malloc package for correctness, and
+ *   evaluate its space utilization in the same pass.
+ *   The idea is to remember the high water mark "hwm" of the heap for 
+ *   an optimal allocator, i.e., no gaps and no internal fragmentation.
+ *   Utilization is the ratio hwm/heapsize, where heapsize is the 
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. Note that mem_sbrk() accepts a
+ *   negative increment, which trims the heap and decommits the pages
+ *   past the new brk, so the heap can end the trace smaller than it
+ *   was; trimming it at the end does not lower heapsize.
+ *   If the trace is valid, *util is set to the utilization and
+ *   *peak_op to the number of requests after which the hwm was first
+ *   reached. If tl is not NULL, the heap is sampled every tl->every
+ *   requests. The heap is also dumped after each of the requests
+ *   chosen with -D.
+ */
+static int eval_mm_valid(trace_t *trace, int tracenum, shadow_t *ranges,
+			 timeline_t *tl, double *util, int *peak_op)
+{
+    cursor_t cur;
+    traceop_t *op;
+    int i, j;
+    int index;
+    int size;
+    int oldsize;
+    int peak = 0;
+    int next_dump = 0;
+    int max_total_size = 0;
+    int total_size = 0;
+    char *newp;
+    char *oldp;
+    char *p;
+    mm_arena_t *arena = NULL;
+    
+    /* Reset the heap and clear the shadow bitmap */
+    mem_reset_brk();
+    clear_ranges(ranges);
 
     /* Call the mm package's init function */
     if (mm_init() < 0) {
@@ -594,12 +1495,20 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	return 0;
     }
 
+    /* Traces with arena requests get a fresh arena on the new heap */
+    trace->num_arena_live = 0;
+    if (trace->uses_arena && (arena = mm_arena_create(0)) == NULL) {
+	malloc_error(tracenum, 0, "mm_arena_create failed.");
+	return 0;
+    }
+
     /* Interpret each operation in the trace in order */
-    for (i = 0;  i < trace->num_ops;  i++) {
-	index = trace->ops[i].index;
-	size = trace->ops[i].size;
+    start_ops(&cur, trace);
+    for (i = 0;  (op = next_op(&cur)) != NULL;  i++) {
+	index = op->index;
+	size = op->size;
 
-        switch (trace->ops[i].type) {
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
 
@@ -627,6 +1536,9 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remember region */
 	    trace->blocks[index] = p;
 	    trace->block_sizes[index] = size;
+
+	    /* Keep track of current total size of all allocated blocks */
+	    total_size += size;
 	    break;
 
         case REALLOC: /* mm_realloc */
@@ -639,7 +1551,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    }
 	    
 	    /* Remove the old region from the range list */
-	    remove_range(ranges, oldp);
+	    remove_range(ranges, oldp, trace->block_sizes[index]);
 	    
 	    /* Check new block for correctness and add it to range list */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
@@ -652,16 +1564,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
-	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	    if (!check_fill(newp, oldsize, index)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
-	      }
 	    }
 	    memset(newp, index & 0xFF, size);
 
 	    /* Remember region */
+	    total_size += size - (int)trace->block_sizes[index];
 	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = size;
 	    break;
@@ -670,113 +1581,293 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
-	    remove_range(ranges, p);
+	    remove_range(ranges, p, trace->block_sizes[index]);
 	    mm_free(p);
+	    total_size -= (int)trace->block_sizes[index];
+	    break;
+
+        case ARENA_ALLOC: /* mm_arena_alloc */
+
+	    /* Check arena blocks exactly like mm_malloc blocks */
+	    if ((p = mm_arena_alloc(arena, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_arena_alloc failed.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+
+	    /* Remember region, and that it dies with the arena */
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    trace->arena_ids[trace->num_arena_live++] = index;
+	    total_size += size;
+	    break;
+
+        case ARENA_RESET: /* mm_arena_reset */
+
+	    /* Every region allocated from the arena dies at once */
+	    for (j = 0; j < trace->num_arena_live; j++) {
+		remove_range(ranges, trace->blocks[trace->arena_ids[j]],
+			     trace->block_sizes[trace->arena_ids[j]]);
+		total_size -= (int)trace->block_sizes[trace->arena_ids[j]];
+	    }
+	    trace->num_arena_live = 0;
+	    mm_arena_reset(arena);
 	    break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	/* Update the utilization statistics */
+	if (total_size > max_total_size) {
+	    max_total_size = total_size;
+	    peak = i + 1;
+	}
+	if (tl != NULL && (i + 1) % tl->every == 0)
+	    frag_sample(tl, i + 1, total_size);
+	for (; next_dump < num_dump_ops && dump_ops[next_dump] == i + 1;
+	     next_dump++)
+	    dump_heap(tracenum, i + 1);
     }
+    if (tl != NULL && (tl->n == 0 || tl->s[tl->n-1].op != i))
+	frag_sample(tl, i, total_size);
+    *peak_op = peak;
+    *util = (double)max_total_size / (double)mem_peaksize();
 
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
 
-/* 
- * eval_mm_util - Evaluate the space utilization of the student's package
- *   The idea is to remember the high water mark "hwm" of the heap for 
- *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
- */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
-{   
-    int i;
-    int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+/*
+ * eval_mm_loss - Replay the first peak_op requests of the trace, which
+ *     leave the most payload bytes live, with mm's accounting on. Then
+ *     break the heap that eval_mm_valid left behind into the live bytes
+ *     and the bytes lost to each cause.
+ */
+static void eval_mm_loss(trace_t *trace, int peak_op, loss_t *loss)
+{
+    cursor_t cur;
+    traceop_t *op;
+    int i, j, index;
+    size_t live = 0;
+    double heap = mem_peaksize();
     char *p;
-    char *newp, *oldp;
+    mm_heap_stats_t hs;
+    mm_arena_t *arena = NULL;
 
-    /* initialize the heap and the mm malloc package */
     mem_reset_brk();
+    mm_account(1);
     if (mm_init() < 0)
-	app_error("mm_init failed in eval_mm_util");
+	app_error("mm_init failed in eval_mm_loss");
+    trace->num_arena_live = 0;
+    if (trace->uses_arena && (arena = mm_arena_create(0)) == NULL)
+	app_error("mm_arena_create failed in eval_mm_loss");
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    start_ops(&cur, trace);
+    for (i = 0; i < peak_op && (op = next_op(&cur)) != NULL; i++) {
+	index = op->index;
+        switch (op->type) {
 
         case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-
-	    if ((p = mm_malloc(size)) == NULL) 
-		app_error("mm_malloc failed in eval_mm_util");
-	    
-	    /* Remember region and size */
+	    if ((p = mm_malloc(op->size)) == NULL) 
+		app_error("mm_malloc failed in eval_mm_loss");
 	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
-	    
-	    /* Keep track of current total size
-	     * of all allocated blocks */
-	    total_size += size;
-	    
-	    /* Update statistics */
-	    max_total_size = (total_size > max_total_size) ?
-		total_size : max_total_size;
+	    trace->block_sizes[index] = op->size;
+	    live += op->size;
 	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldsize = trace->block_sizes[index];
+	    if ((p = mm_realloc(trace->blocks[index], op->size)) == NULL)
+		app_error("mm_realloc failed in eval_mm_loss");
+	    live += op->size - trace->block_sizes[index];
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = op->size;
+	    break;
 
-	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc failed in eval_mm_util");
+        case FREE: /* mm_free */
+	    mm_free(trace->blocks[index]);
+	    live -= trace->block_sizes[index];
+	    break;
 
-	    /* Remember region and size */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = newsize;
-	    
-	    /* Keep track of current total size
-	     * of all allocated blocks */
-	    total_size += (newsize - oldsize);
-	    
-	    /* Update statistics */
-	    max_total_size = (total_size > max_total_size) ?
-		total_size : max_total_size;
+	case ARENA_ALLOC: /* mm_arena_alloc */
+	    if ((p = mm_arena_alloc(arena, op->size)) == NULL) 
+		app_error("mm_arena_alloc failed in eval_mm_loss");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = op->size;
+	    trace->arena_ids[trace->num_arena_live++] = index;
+	    live += op->size;
 	    break;
 
-        case FREE: /* mm_free */
-	    index = trace->ops[i].index;
-	    size = trace->block_sizes[index];
-	    p = trace->blocks[index];
-	    
-	    mm_free(p);
-	    
-	    /* Keep track of current total size
-	     * of all allocated blocks */
-	    total_size -= size;
-	    
+	case ARENA_RESET: /* mm_arena_reset */
+	    for (j = 0; j < trace->num_arena_live; j++)
+		live -= trace->block_sizes[trace->arena_ids[j]];
+	    trace->num_arena_live = 0;
+	    mm_arena_reset(arena);
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_util");
-
+	    app_error("Nonexistent request type in eval_mm_loss");
         }
     }
+    mm_heap_stats(&hs);
+    mm_account(0);
+
+    loss->op = peak_op;
+    loss->tags = hs.tag_bytes / heap;
+    loss->padding = hs.pad_bytes / heap;
+    loss->slack = hs.slack_bytes / heap;
+    loss->free = (hs.free_bytes + (heap - hs.heap_bytes)) / heap;
+    loss->other = 1.0 - live / heap - loss->tags - loss->padding - 
+	loss->slack - loss->free;
+}
+
+/*
+ * cmp_int - qsort comparison of two ints
+ */
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * parse_dump_ops - Set the requests after which to dump the heap from
+ *     a comma-separated list of request numbers
+ */
+static void parse_dump_ops(char *list)
+{
+    char *tok;
+    int n = 1;
+
+    for (tok = list; *tok; tok++)
+	n += (*tok == ',');
+    if ((dump_ops = (int *)malloc(n * sizeof(int))) == NULL)
+	unix_error("malloc failed in parse_dump_ops");
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ","))
+	if ((dump_ops[num_dump_ops++] = atoi(tok)) <= 0)
+	    app_error("-D needs a list of positive request numbers");
+    qsort(dump_ops, num_dump_ops, sizeof(int), cmp_int);
+}
+
+/*
+ * dump_heap - Write a snapshot of the heap after op requests of trace
+ *     tracenum to trace<tracenum>-<op>.heap, for heapmap to analyze
+ */
+static void dump_heap(int tracenum, int op)
+{
+    char path[MAXLINE];
+    int fd;
+
+    sprintf(path, "trace%d-%d.heap", tracenum, op);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	unix_error(path);
+    if (mm_dump_heap(fd) < 0 || close(fd) < 0)
+	unix_error(path);
+    if (verbose > 1)
+	printf("wrote heap snapshot %s, ", path);
+}
+
+/*
+ * frag_sample - Walk the heap after op requests, when the live blocks
+ *     hold live payload bytes, and add the result to the timeline
+ */
+static void frag_sample(timeline_t *tl, int op, size_t live)
+{
+    mm_heap_stats_t hs;
+    frag_sample_t *s;
+
+    if (tl->n == tl->max) {
+	tl->max = (tl->max > 0) ? 2 * tl->max : 64;
+	if ((tl->s = (frag_sample_t *)
+	     realloc(tl->s, tl->max * sizeof(frag_sample_t))) == NULL)
+	    unix_error("realloc of the timeline failed in frag_sample");
+    }
+    mm_heap_stats(&hs);
+    s = &tl->s[tl->n++];
+    s->op = op;
+    s->live = live;
+    s->heap = hs.heap_bytes;
+    s->internal = hs.alloc_bytes - live;
+    s->external = hs.free_bytes;
+    s->largest = hs.largest_free;
+}
+
+/*
+ * timeline_summary - Return the time-weighted average utilization of
+ *     a timeline, where each sample stands for the requests since the
+ *     previous one, and point *worst at the sample with the lowest
+ *     utilization. Samples with less than half of the peak live bytes
+ *     cannot be the worst, or an emptying heap always would be.
+ */
+static double timeline_summary(timeline_t *tl, frag_sample_t **worst)
+{
+    frag_sample_t *s;
+    size_t peak = 0;
+    double sum = 0;
+    int k, prev = 0;
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    for (k = 0; k < tl->n; k++)
+	if (tl->s[k].live > peak)
+	    peak = tl->s[k].live;
+    *worst = NULL;
+    for (k = 0; k < tl->n; k++) {
+	s = &tl->s[k];
+	if (s->heap > 0)
+	    sum += (double)(s->op - prev) * s->live / s->heap;
+	prev = s->op;
+	if (2 * s->live >= peak && (*worst == NULL || 
+	     (double)s->live / s->heap < 
+	     (double)(*worst)->live / (*worst)->heap))
+	    *worst = s;
+    }
+    return (prev > 0) ? sum / prev : 0;
 }
 
+/*
+ * run_mm_ops - Interpret the requests of a streamed trace, which is
+ *     not compiled, on mm for eval_mm_speed
+ */
+static void run_mm_ops(trace_t *trace, mm_arena_t *arena)
+{
+    cursor_t cur;
+    traceop_t *op;
+    char *p;
+
+    start_ops(&cur, trace);
+    while ((op = next_op(&cur)) != NULL)
+        switch (op->type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc error in eval_mm_speed");
+            trace->blocks[op->index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[op->index], op->size)) == NULL)
+		app_error("mm_realloc error in eval_mm_speed");
+            trace->blocks[op->index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            mm_free(trace->blocks[op->index]);
+            break;
+
+	case ARENA_ALLOC: /* mm_arena_alloc */
+            if ((p = mm_arena_alloc(arena, op->size)) == NULL)
+		app_error("mm_arena_alloc error in eval_mm_speed");
+            trace->blocks[op->index] = p;
+            break;
+
+	case ARENA_RESET: /* mm_arena_reset */
+	    mm_arena_reset(arena);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_speed");
+        }
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -784,130 +1875,1454 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
+    codeop_t *c;
+    char *p;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    perfctr_t *pc = ((speed_t *)ptr)->pc;
+    mm_arena_t *arena = NULL;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
     if (mm_init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
+    if (trace->uses_arena && (arena = mm_arena_create(0)) == NULL)
+	app_error("mm_arena_create failed in eval_mm_speed");
 
-    /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    /* Run each compiled trace request */
+    if (pc != NULL)
+	perfctr_start(pc);
+    if (trace->code == NULL)
+	run_mm_ops(trace, arena);
+    else for (c = trace->code; c->type >= 0; c++)
+        switch (c->type) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_malloc(c->size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
+            *c->slot = p;
             break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((p = mm_realloc(*c->slot, c->size)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
+            *c->slot = p;
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            mm_free(block);
+            mm_free(*c->slot);
+            break;
+
+	case ARENA_ALLOC: /* mm_arena_alloc */
+            if ((p = mm_arena_alloc(arena, c->size)) == NULL)
+		app_error("mm_arena_alloc error in eval_mm_speed");
+            *c->slot = p;
             break;
 
+	case ARENA_RESET: /* mm_arena_reset */
+	    mm_arena_reset(arena);
+	    break;
+
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_mm_speed");
         }
+    if (pc != NULL)
+	perfctr_stop(pc);
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * The null allocator does no work, so the time of a replay on it is
+ * what the loop, the dispatch and the stores to the slots cost (-I).
+ * Its functions are kept out of line, like the allocators' own.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static char null_block[ALIGNMENT];
+
+static __attribute__((noinline)) void *null_malloc(size_t size)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    __asm__ __volatile__("" : : : "memory");
+    return null_block;
+}
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+static __attribute__((noinline)) void *null_realloc(void *ptr, size_t size)
+{
+    __asm__ __volatile__("" : : : "memory");
+    return null_block;
+}
 
-        case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = p;
-	    break;
+static __attribute__((noinline)) void null_free(void *ptr)
+{
+    __asm__ __volatile__("" : : : "memory");
+}
 
-	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
-	    if ((newp = realloc(oldp, newsize)) == NULL) {
-		malloc_error(tracenum, i, "libc realloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = newp;
-	    break;
-	    
-        case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
-	    break;
+/*
+ * eval_null_speed - Used by fsecs to time the replay of a trace on
+ *     the null allocator, the way eval_mm_speed replays it on mm
+ */
+static void eval_null_speed(void *ptr)
+{
+    codeop_t *c;
+    char *p;
+    trace_t *trace = ((speed_t *)ptr)->trace;
 
-	default:
-	    app_error("invalid operation type  in eval_libc_valid");
-	}
-    }
+    for (c = trace->code; c->type >= 0; c++)
+        switch (c->type) {
 
-    return 1;
+        case ALLOC: /* null_malloc */
+	case ARENA_ALLOC:
+            if ((p = null_malloc(c->size)) == NULL)
+		app_error("null_malloc error in eval_null_speed");
+            *c->slot = p;
+            break;
+
+	case REALLOC: /* null_realloc */
+            if ((p = null_realloc(*c->slot, c->size)) == NULL)
+		app_error("null_realloc error in eval_null_speed");
+            *c->slot = p;
+            break;
+
+        case FREE: /* null_free */
+	case ARENA_RESET:
+            null_free(c->slot ? *c->slot : NULL);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_null_speed");
+        }
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * count_speed - Run the speed function f once more with the hardware
+ *     counters on, and record their counts per request in stats
  */
-static void eval_libc_speed(void *ptr)
+static void count_speed(fsecs_test_funct f, speed_t *params, 
+			perfctr_t *pc, stats_t *stats)
 {
     int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-        case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
-		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
-	    break;
+    params->pc = pc;
+    f(params);
+    params->pc = NULL;
+    for (i = 0; i < PC_NUM; i++)
+	stats->ctr[i] = (pc->fd[i] >= 0) ? pc->value[i] / stats->ops : -1;
+    stats->counted = 1;
+}
 
-	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-	    if ((newp = realloc(oldp, newsize)) == NULL)
+/*
+ * time_trace - Time the speed function f on a trace with fsecs, or
+ *     with the robust runner under -R, and record the time in stats
+ */
+static void time_trace(fsecs_test_funct f, speed_t *params, stats_t *stats)
+{
+    if (robust) {
+	robust_secs(f, params, &stats->rob);
+	stats->secs = stats->rob.median;
+    }
+    else
+	stats->secs = fsecs(f, params);
+}
+
+/*
+ * touch_trace - Time the touch replay f of a trace with fsecs, which
+ *     needs a liveness flag per id
+ */
+static double touch_trace(fsecs_test_funct f, speed_t *params)
+{
+    double secs;
+
+    if ((params->live = (char *)malloc(params->trace->num_ids)) == NULL)
+	unix_error("malloc of the live flags failed in touch_trace");
+    secs = fsecs(f, params);
+    free(params->live);
+    params->live = NULL;
+    return secs;
+}
+
+/*
+ * touch_block - Read and write one byte in every TOUCH_LINE bytes of the
+ *     first frac of the size byte payload at p
+ */
+static inline void touch_block(char *p, int size, double frac)
+{
+    int off, len = (int)(size * frac);
+
+    if (len < 1)
+	len = 1;
+    for (off = 0; off < len; off += TOUCH_LINE)
+	p[off]++;
+}
+
+/*
+ * touch_replay - Replay a trace on mm (use_mm) or libc, touching the
+ *     payload of each block as it is allocated, and every TOUCH_PERIOD
+ *     requests the payloads of a few live blocks picked at random
+ */
+static void touch_replay(speed_t *params, int use_mm)
+{
+    trace_t *trace = params->trace;
+    char *live = params->live;
+    double frac = params->touch;
+    cursor_t cur;
+    traceop_t *op;
+    mm_arena_t *arena = NULL;
+    char *p;
+    unsigned int seed = 1;
+    int i, j, k, index;
+
+    memset(live, 0, trace->num_ids);
+    if (use_mm) {
+	mem_reset_brk();
+	if (mm_init() < 0) 
+	    app_error("mm_init failed in touch_replay");
+	if (trace->uses_arena && (arena = mm_arena_create(0)) == NULL)
+	    app_error("mm_arena_create failed in touch_replay");
+    }
+    trace->num_arena_live = 0;
+
+    start_ops(&cur, trace);
+    for (i = 0;  (op = next_op(&cur)) != NULL;  i++) {
+	index = op->index;
+	switch (op->type) {
+
+	case ALLOC: /* malloc */
+	    p = use_mm ? mm_malloc(op->size) : malloc(op->size);
+	    if (p == NULL)
+		app_error("malloc failed in touch_replay");
+	    touch_block(p, op->size, frac);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = op->size;
+	    live[index] = 1;
+	    break;
+
+	case REALLOC: /* realloc */
+	    p = trace->blocks[index];
+	    p = use_mm ? mm_realloc(p, op->size) : realloc(p, op->size);
+	    if (p == NULL)
+		app_error("realloc failed in touch_replay");
+	    touch_block(p, op->size, frac);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = op->size;
+	    break;
+
+	case FREE: /* free */
+	    if (use_mm)
+		mm_free(trace->blocks[index]);
+	    else
+		free(trace->blocks[index]);
+	    live[index] = 0;
+	    break;
+
+	case ARENA_ALLOC: /* arena alloc, emulated on libc */
+	    p = use_mm ? mm_arena_alloc(arena, op->size) : malloc(op->size);
+	    if (p == NULL)
+		app_error("arena alloc failed in touch_replay");
+	    touch_block(p, op->size, frac);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = op->size;
+	    trace->arena_ids[trace->num_arena_live++] = index;
+	    live[index] = 1;
+	    break;
+
+	case ARENA_RESET: /* arena reset, emulated on libc */
+	    for (j = 0; j < trace->num_arena_live; j++) {
+		if (!use_mm)
+		    free(trace->blocks[trace->arena_ids[j]]);
+		live[trace->arena_ids[j]] = 0;
+	    }
+	    trace->num_arena_live = 0;
+	    if (use_mm)
+		mm_arena_reset(arena);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in touch_replay");
+	}
+
+	/* the program goes back to some of its older objects */
+	if (i % TOUCH_PERIOD == TOUCH_PERIOD - 1)
+	    for (j = 0; j < TOUCH_BLOCKS; j++) {
+		seed = seed * 1103515245 + 12345;
+		k = (seed >> 8) % trace->num_ids;
+		if (live[k])
+		    touch_block(trace->blocks[k], trace->block_sizes[k], frac);
+	    }
+    }
+
+    /* libc blocks would outlive the run */
+    if (!use_mm)
+	for (k = 0; k < trace->num_ids; k++)
+	    if (live[k])
+		free(trace->blocks[k]);
+}
+
+/*
+ * eval_mm_touch - Used by fsecs to time the touch replay on mm
+ */
+static void eval_mm_touch(void *ptr)
+{
+    touch_replay((speed_t *)ptr, 1);
+}
+
+/*
+ * eval_libc_touch - Used by fsecs to time the touch replay on libc
+ */
+static void eval_libc_touch(void *ptr)
+{
+    touch_replay((speed_t *)ptr, 0);
+}
+
+/*
+ * lat_now - a timestamp in nanoseconds for timing single requests
+ */
+static inline unsigned long long lat_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * calibrate_latency - the cost in ns of the pair of lat_now calls that
+ *     brackets every timed request. This is the smallest of many
+ *     back-to-back pairs, so it never exceeds the true overhead.
+ */
+static unsigned long long calibrate_latency(void)
+{
+    unsigned long long t0, t1, min = ~0ULL;
+    int i;
+
+    for (i = 0; i < LAT_CALIBRATE; i++) {
+	t0 = lat_now();
+	t1 = lat_now();
+	if (t1 - t0 < min)
+	    min = t1 - t0;
+    }
+    return min;
+}
+
+/*
+ * eval_mm_latency - Replay the trace once on the mm package, timing each
+ *    request on its own. Adds the latencies, less the timer overhead,
+ *    to the per request type histograms in lat.
+ */
+static void eval_mm_latency(trace_t *trace, hist_t *lat, 
+			    unsigned long long overhead)
+{
+    cursor_t cur;
+    traceop_t *op;
+    unsigned long long t0, t1;
+    char *p = NULL;
+    mm_arena_t *arena = NULL;
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+    if (trace->uses_arena && (arena = mm_arena_create(0)) == NULL)
+	app_error("mm_arena_create failed in eval_mm_latency");
+
+    start_ops(&cur, trace);
+    while ((op = next_op(&cur)) != NULL) {
+	t0 = lat_now();
+	switch (op->type) {
+	case ALLOC:
+	    p = mm_malloc(op->size);
+	    break;
+	case REALLOC:
+	    p = mm_realloc(trace->blocks[op->index], op->size);
+	    break;
+	case FREE:
+	    mm_free(trace->blocks[op->index]);
+	    break;
+	case ARENA_ALLOC:
+	    p = mm_arena_alloc(arena, op->size);
+	    break;
+	case ARENA_RESET:
+	    mm_arena_reset(arena);
+	    break;
+	}
+	t1 = lat_now();
+	t1 = (t1 - t0 > overhead) ? t1 - t0 - overhead : 0;
+	hist_add(&lat[op->type], t1);
+
+	if (op->type != FREE && op->type != ARENA_RESET) {
+	    if (p == NULL)
+		app_error("allocation failed in eval_mm_latency");
+	    trace->blocks[op->index] = p;
+	}
+    }
+}
+
+/*
+ * eval_mm_open - Replay the trace once on the mm package open-loop:
+ *    each request is issued when it arrives, its gap times scale after
+ *    the previous one, whether or not the requests before it are done.
+ *    Records each request's service time (from its issue) and response
+ *    time (from its arrival), less the timer overhead, in stats->open.
+ *    A request that arrives while a slow one runs waits for it, and
+ *    only its response time counts the wait: a closed-loop replay
+ *    would have issued it late and never seen the delay.
+ */
+static void eval_mm_open(trace_t *trace, double scale, 
+			 unsigned long long overhead, stats_t *stats)
+{
+    cursor_t cur;
+    traceop_t *op;
+    unsigned long long t0, due, start, end;
+    double arrival = 0;  /* ns from t0 to the arrival of the request */
+    long n = 0, late = 0;
+    char *p = NULL;
+    mm_arena_t *arena = NULL;
+
+    if ((stats->open = (hist_t *)malloc(2 * sizeof(hist_t))) == NULL)
+	unix_error("malloc of open-loop histograms failed in eval_mm_open");
+    hist_init(&stats->open[0]);
+    hist_init(&stats->open[1]);
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_open");
+    if (trace->uses_arena && (arena = mm_arena_create(0)) == NULL)
+	app_error("mm_arena_create failed in eval_mm_open");
+
+    start_ops(&cur, trace);
+    t0 = lat_now();
+    while ((op = next_op(&cur)) != NULL) {
+	arrival += op->gap * scale;
+	due = t0 + (unsigned long long)arrival;
+	while ((start = lat_now()) < due)
+	    ;  /* spin until the request arrives */
+	if (start - due > OPEN_LATE)
+	    late++;
+	switch (op->type) {
+	case ALLOC:
+	    p = mm_malloc(op->size);
+	    break;
+	case REALLOC:
+	    p = mm_realloc(trace->blocks[op->index], op->size);
+	    break;
+	case FREE:
+	    mm_free(trace->blocks[op->index]);
+	    break;
+	case ARENA_ALLOC:
+	    p = mm_arena_alloc(arena, op->size);
+	    break;
+	case ARENA_RESET:
+	    mm_arena_reset(arena);
+	    break;
+	}
+	end = lat_now();
+	hist_add(&stats->open[0], 
+		 (end - start > overhead) ? end - start - overhead : 0);
+	hist_add(&stats->open[1], 
+		 (end - due > overhead) ? end - due - overhead : 0);
+	n++;
+
+	if (op->type != FREE && op->type != ARENA_RESET) {
+	    if (p == NULL)
+		app_error("allocation failed in eval_mm_open");
+	    trace->blocks[op->index] = p;
+	}
+    }
+
+    /* A text trace may turn out to have no gaps at all */
+    if (arrival == 0) {
+	free(stats->open);
+	stats->open = NULL;
+	return;
+    }
+    stats->offered = n / (arrival / 1e9);
+    stats->late = (double)late / n;
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace, int tracenum)
+{
+    cursor_t cur;
+    traceop_t *op;
+    int i, j, newsize;
+    char *p, *newp, *oldp;
+
+    trace->num_arena_live = 0;
+    start_ops(&cur, trace);
+    for (i = 0;  (op = next_op(&cur)) != NULL;  i++) {
+        switch (op->type) {
+
+        case ARENA_ALLOC: /* libc has no arenas, so track the blocks */
+	    trace->arena_ids[trace->num_arena_live++] = op->index;
+	    /* fall through */
+        case ALLOC: /* malloc */
+	    if ((p = malloc(op->size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[op->index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
+            newsize = op->size;
+	    oldp = trace->blocks[op->index];
+	    if ((newp = realloc(oldp, newsize)) == NULL) {
+		malloc_error(tracenum, i, "libc realloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[op->index] = newp;
+	    break;
+	    
+        case FREE: /* free */
+	    free(trace->blocks[op->index]);
+	    break;
+
+        case ARENA_RESET: /* free each block allocated since last reset */
+	    for (j = 0; j < trace->num_arena_live; j++)
+		free(trace->blocks[trace->arena_ids[j]]);
+	    trace->num_arena_live = 0;
+	    break;
+
+	default:
+	    app_error("invalid operation type  in eval_libc_valid");
+	}
+    }
+
+    return 1;
+}
+
+/*
+ * run_libc_ops - Interpret the requests of a streamed trace, which is
+ *     not compiled, on libc for eval_libc_speed
+ */
+static void run_libc_ops(trace_t *trace)
+{
+    cursor_t cur;
+    traceop_t *op;
+    char *p;
+    int j;
+
+    start_ops(&cur, trace);
+    while ((op = next_op(&cur)) != NULL) {
+        switch (op->type) {
+        case ARENA_ALLOC: /* libc has no arenas, so track the blocks */
+	    trace->arena_ids[trace->num_arena_live++] = op->index;
+	    /* fall through */
+        case ALLOC: /* malloc */
+	    if ((p = malloc(op->size)) == NULL)
+		unix_error("malloc failed in eval_libc_speed");
+	    trace->blocks[op->index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
+	    if ((p = realloc(trace->blocks[op->index], op->size)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
+	    trace->blocks[op->index] = p;
+	    break;
 	    
-	    trace->blocks[index] = newp;
+        case FREE: /* free */
+	    free(trace->blocks[op->index]);
+	    break;
+
+        case ARENA_RESET: /* free each block allocated since last reset */
+	    for (j = 0; j < trace->num_arena_live; j++)
+		free(trace->blocks[trace->arena_ids[j]]);
+	    trace->num_arena_live = 0;
+	    break;
+	}
+    }
+}
+
+/* 
+ * eval_libc_speed - This is the function that is used by fcyc() to
+ *    measure the running time of the libc malloc package on the set
+ *    of traces.
+ */
+static void eval_libc_speed(void *ptr)
+{
+    codeop_t *c;
+    char *p;
+    int j;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    perfctr_t *pc = ((speed_t *)ptr)->pc;
+
+    trace->num_arena_live = 0;
+    if (pc != NULL)
+	perfctr_start(pc);
+    if (trace->code == NULL)
+	run_libc_ops(trace);
+    else for (c = trace->code; c->type >= 0; c++) {
+        switch (c->type) {
+        case ARENA_ALLOC: /* libc has no arenas, so track the blocks */
+	    trace->arena_ids[trace->num_arena_live++] = c->slot - trace->blocks;
+	    /* fall through */
+        case ALLOC: /* malloc */
+	    if ((p = malloc(c->size)) == NULL)
+		unix_error("malloc failed in eval_libc_speed");
+	    *c->slot = p;
+	    break;
+
+	case REALLOC: /* realloc */
+	    if ((p = realloc(*c->slot, c->size)) == NULL)
+		unix_error("realloc failed in eval_libc_speed\n");
+	    *c->slot = p;
 	    break;
 	    
         case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
-	    free(block);
+	    free(*c->slot);
+	    break;
+
+        case ARENA_RESET: /* free each block allocated since last reset */
+	    for (j = 0; j < trace->num_arena_live; j++)
+		free(trace->blocks[trace->arena_ids[j]]);
+	    trace->num_arena_live = 0;
+	    break;
+	}
+    }
+    if (pc != NULL)
+	perfctr_stop(pc);
+}
+
+/*****************************************************************
+ * Multi-tenant mix (-M). The traces become the tenants of one trace,
+ * which takes its next request from one tenant after another
+ * (round-robin) or from a tenant picked at random by weight. The mix
+ * runs on a single heap, so the blocks of each tenant end up between
+ * those of the others, as they do in a server whose request types
+ * share one allocator.
+ ****************************************************************/
+
+/*
+ * parse_mix - parse the policy of -M: rr, rand, or rand:w0,w1,...
+ *     with one weight per trace
+ */
+static void parse_mix(char *policy, mix_t *mix)
+{
+    char *copy, *w, *save = NULL;
+    int n = 0;
+
+    mix->weights = NULL;
+    mix->n = 0;
+    if (!strcmp(policy, "rr")) {
+	mix->random = 0;
+	return;
+    }
+    mix->random = 1;
+    if (!strcmp(policy, "rand"))
+	return;
+    if (strncmp(policy, "rand:", 5) || (copy = strdup(policy + 5)) == NULL)
+	app_error("-M needs rr, rand or rand:<weight>,...");
+    for (w = strtok_r(copy, ",", &save); w != NULL; 
+	 w = strtok_r(NULL, ",", &save)) {
+	if ((mix->weights = realloc(mix->weights, 
+				    (n + 1) * sizeof(double))) == NULL)
+	    unix_error("realloc failed in parse_mix");
+	if ((mix->weights[n++] = atof(w)) <= 0)
+	    app_error("-M needs positive weights");
+    }
+    free(copy);
+    mix->n = n;   /* checked against the number of traces by mix_traces */
+}
+
+/*
+ * mix_traces - Interleave the requests of the n loaded traces into
+ *     mix->trace, by the policy parse_mix read. Each trace keeps its
+ *     own order, and its ids are moved past those of the traces
+ *     before it. The picks use a fixed seed, so a mix of the same
+ *     traces is the same on every run.
+ */
+static void mix_traces(trace_t **traces, int n, mix_t *mix)
+{
+    trace_t *trace;
+    cursor_t *cur;
+    traceop_t *op;
+    int *first_id, *left;
+    unsigned int seed = 1;
+    double total, u;
+    int i, k = n - 1, num_ops = 0, num_ids = 0;
+
+    if (mix->weights != NULL && mix->n != n) {
+	sprintf(msg, "-M has %d weights for %d traces", mix->n, n);
+	app_error(msg);
+    }
+    mix->n = n;
+    memset(&mix->stats, 0, sizeof(stats_t));
+    if ((cur = (cursor_t *)malloc(n * sizeof(cursor_t))) == NULL ||
+	(first_id = (int *)malloc(n * sizeof(int))) == NULL ||
+	(left = (int *)malloc(n * sizeof(int))) == NULL ||
+	(mix->tenants = (stats_t *)calloc(n, sizeof(stats_t))) == NULL ||
+	(trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL)
+	unix_error("malloc failed in mix_traces");
+    for (i = 0; i < n; i++) {
+	/* one heap holds a single arena, which the tenants can't share */
+	if (traces[i]->uses_arena)
+	    app_error("-M cannot mix traces with arena requests");
+	start_ops(&cur[i], traces[i]);
+	first_id[i] = num_ids;
+	left[i] = traces[i]->num_ops;
+	num_ids += traces[i]->num_ids;
+	num_ops += traces[i]->num_ops;
+	mix->tenants[i].ops = traces[i]->num_ops;
+    }
+    if ((trace->ops = (traceop_t *)malloc(num_ops * sizeof(traceop_t))) == NULL ||
+	(mix->tenant = (int *)malloc(num_ops * sizeof(int))) == NULL)
+	unix_error("malloc failed in mix_traces");
+
+    for (i = 0; i < num_ops; i++) {
+	/* pick the tenant of the next request among those with any left */
+	if (!mix->random)
+	    do
+		k = (k + 1) % n;
+	    while (left[k] == 0);
+	else {
+	    for (total = 0, k = 0; k < n; k++)
+		if (left[k] > 0)
+		    total += mix->weights ? mix->weights[k] : left[k];
+	    u = total * rand_r(&seed) / ((double)RAND_MAX + 1);
+	    for (k = 0; k < n; k++) {
+		if (left[k] == 0)
+		    continue;
+		if ((u -= mix->weights ? mix->weights[k] : left[k]) < 0)
+		    break;
+	    }
+	    while (k == n || left[k] == 0)  /* rounding ran past the end */
+		k = (k == n) ? 0 : k + 1;
+	}
+	op = next_op(&cur[k]);
+	left[k]--;
+	trace->ops[i] = *op;
+	trace->ops[i].index += first_id[k];
+	mix->tenant[i] = k;
+    }
+
+    trace->num_ids = num_ids;
+    trace->num_ops = num_ops;
+    trace->weight = 1;
+    prepare_trace(trace);
+    mix->trace = trace;
+    free(cur);
+    free(first_id);
+    free(left);
+}
+
+/*
+ * mix_util - Give each tenant the payload bytes it had live after the
+ *     first peak_op requests of the mix, where the mix's own live bytes
+ *     peaked, as its share of the heap's utilization
+ */
+static void mix_util(mix_t *mix, int peak_op)
+{
+    trace_t *trace = mix->trace;
+    traceop_t *op;
+    double *live;
+    int i;
+
+    if ((live = (double *)calloc(mix->n, sizeof(double))) == NULL)
+	unix_error("calloc failed in mix_util");
+    for (i = 0; i < peak_op; i++) {
+	op = &trace->ops[i];
+	if (op->type != ALLOC)
+	    live[mix->tenant[i]] -= trace->block_sizes[op->index];
+	if (op->type != FREE) {
+	    live[mix->tenant[i]] += op->size;
+	    trace->block_sizes[op->index] = op->size;
+	}
+    }
+    for (i = 0; i < mix->n; i++)
+	mix->tenants[i].util = live[i] / mem_peaksize();
+    free(live);
+}
+
+/*
+ * time_tenants - Replay the mix once, timing each request on its own,
+ *     and charge the time, less the timer's overhead, to its tenant
+ */
+static void time_tenants(mix_t *mix, unsigned long long overhead)
+{
+    codeop_t *c;
+    unsigned long long t0, t1;
+    int i;
+    char *p = NULL;
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in time_tenants");
+    for (c = mix->trace->code, i = 0; c->type >= 0; c++, i++) {
+	t0 = lat_now();
+	switch (c->type) {
+	case ALLOC:
+	    p = mm_malloc(c->size);
+	    break;
+	case REALLOC:
+	    p = mm_realloc(*c->slot, c->size);
+	    break;
+	case FREE:
+	    mm_free(*c->slot);
+	    break;
+	}
+	t1 = lat_now();
+	t1 = (t1 - t0 > overhead) ? t1 - t0 - overhead : 0;
+	mix->tenants[mix->tenant[i]].secs += t1 / 1e9;
+
+	if (c->type != FREE) {
+	    if (p == NULL)
+		app_error("allocation failed in time_tenants");
+	    *c->slot = p;
+	}
+    }
+}
+
+/*
+ * eval_mix - Check the mix for correctness and utilization on one
+ *     heap, then time it as a whole and each tenant's share of it.
+ *     Errors are reported as those of trace tracenum.
+ */
+static void eval_mix(mix_t *mix, int tracenum, unsigned long long overhead)
+{
+    static shadow_t ranges = {NULL};
+    speed_t speed_params;
+    int peak_op, i;
+
+    if (verbose > 1)
+	printf("Checking the mix of %d traces\n", mix->n);
+    mix->stats.valid = eval_mm_valid(mix->trace, tracenum, &ranges, NULL,
+				     &mix->stats.util, &peak_op);
+    mix->stats.ops = mix->trace->num_ops;
+    for (i = 0; i < mix->n; i++)
+	mix->tenants[i].valid = mix->stats.valid;
+    if (!mix->stats.valid)
+	return;
+    mix->stats.sbrks = mem_sbrkcount();
+    mix_util(mix, peak_op);
+
+    speed_params.trace = mix->trace;
+    speed_params.ranges = &ranges;
+    speed_params.pc = NULL;
+    speed_params.touch = 0;
+    speed_params.live = NULL;
+    time_trace(eval_mm_speed, &speed_params, &mix->stats);
+    time_tenants(mix, overhead);
+}
+
+/*
+ * free_mix - Free the interleaved trace and the results of a mix
+ */
+static void free_mix(mix_t *mix)
+{
+    free_trace(mix->trace);
+    free(mix->tenant);
+    free(mix->tenants);
+    free(mix->weights);
+}
+
+/*****************************************************************
+ * Worker processes (-w). Each worker is forked with a copy of the
+ * loaded traces and of the heap, takes the next trace that nobody
+ * has evaluated yet, and sends its results back over a pipe. The
+ * workers run at the same time, so they share the caches and memory
+ * bandwidth of the machine; use one worker for the most faithful
+ * timing.
+ ****************************************************************/
+
+/*
+ * write_all - write all n bytes at buf to fd, or exit
+ */
+static void write_all(int fd, const void *buf, size_t n)
+{
+    const char *p = (const char *)buf;
+    ssize_t rc;
+
+    while (n > 0) {
+	if ((rc = write(fd, p, n)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("write failed in write_all");
+	}
+	p += rc;
+	n -= rc;
+    }
+}
+
+/*
+ * read_all - read n bytes from fd into buf. Returns 1 on success and 0
+ *     at the end of the file before any byte; exits on a short read.
+ */
+static int read_all(int fd, void *buf, size_t n)
+{
+    char *p = (char *)buf;
+    ssize_t rc;
+
+    while (n > 0) {
+	if ((rc = read(fd, p, n)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("read failed in read_all");
+	}
+	if (rc == 0) {
+	    if (p == (char *)buf)
+		return 0;
+	    app_error("A worker's results were cut short");
+	}
+	p += rc;
+	n -= rc;
+    }
+    return 1;
+}
+
+/*
+ * send_stats - send the results of trace i to the parent: the errors it
+ *     caused, its stats, and what they point to
+ */
+static void send_stats(int fd, int i, int errs, stats_t *libc_stats, 
+		       stats_t *mm_stats)
+{
+    write_all(fd, &i, sizeof(int));
+    write_all(fd, &errs, sizeof(int));
+    if (libc_stats != NULL)
+	write_all(fd, libc_stats, sizeof(stats_t));
+    write_all(fd, mm_stats, sizeof(stats_t));
+    if (mm_stats->lat != NULL)
+	write_all(fd, mm_stats->lat, NUM_OPTYPES * sizeof(hist_t));
+    if (mm_stats->open != NULL)
+	write_all(fd, mm_stats->open, 2 * sizeof(hist_t));
+    if (mm_stats->tl.n > 0)
+	write_all(fd, mm_stats->tl.s, mm_stats->tl.n * sizeof(frag_sample_t));
+}
+
+/*
+ * recv_stats - receive the results of one trace from a worker into the
+ *     stats arrays. Returns 0 once the worker has sent everything.
+ */
+static int recv_stats(int fd, stats_t *libc_stats, stats_t *mm_stats)
+{
+    stats_t *st;
+    int i, errs;
+
+    if (!read_all(fd, &i, sizeof(int)))
+	return 0;
+    read_all(fd, &errs, sizeof(int));
+    errors += errs;
+    if (libc_stats != NULL)
+	read_all(fd, &libc_stats[i], sizeof(stats_t));
+    st = &mm_stats[i];
+    read_all(fd, st, sizeof(stats_t));
+    if (st->lat != NULL) {
+	if ((st->lat = (hist_t *)malloc(NUM_OPTYPES * sizeof(hist_t))) == NULL)
+	    unix_error("malloc failed in recv_stats");
+	read_all(fd, st->lat, NUM_OPTYPES * sizeof(hist_t));
+    }
+    if (st->open != NULL) {
+	if ((st->open = (hist_t *)malloc(2 * sizeof(hist_t))) == NULL)
+	    unix_error("malloc failed in recv_stats");
+	read_all(fd, st->open, 2 * sizeof(hist_t));
+    }
+    if (st->tl.n > 0) {
+	if ((st->tl.s = (frag_sample_t *)
+	     malloc(st->tl.n * sizeof(frag_sample_t))) == NULL)
+	    unix_error("malloc failed in recv_stats");
+	read_all(fd, st->tl.s, st->tl.n * sizeof(frag_sample_t));
+	st->tl.max = st->tl.n;
+    }
+    return 1;
+}
+
+/*
+ * run_workers - Evaluate the n traces on the given number of forked
+ *     worker processes, and collect their results
+ */
+static void run_workers(trace_t **traces, int n, int workers, evalopts_t *o,
+			stats_t *libc_stats, stats_t *mm_stats)
+{
+    int *next;   /* the next trace to evaluate, shared by the workers */
+    int *fds;
+    pid_t *pids;
+    perfctr_t pc;
+    int i, w, before, status, fd[2];
+
+    if (workers > n)
+	workers = n;
+    next = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, 
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next == MAP_FAILED)
+	unix_error("mmap failed in run_workers");
+    *next = 0;
+    if ((fds = (int *)malloc(workers * sizeof(int))) == NULL ||
+	(pids = (pid_t *)malloc(workers * sizeof(pid_t))) == NULL)
+	unix_error("malloc failed in run_workers");
+
+    fflush(stdout);
+    fflush(stderr);
+    for (w = 0; w < workers; w++) {
+	if (pipe(fd) < 0 || (pids[w] = fork()) < 0)
+	    unix_error("Could not start a worker");
+	if (pids[w] == 0) {
+	    /* The counters opened by the parent count the parent only */
+	    close(fd[0]);
+	    if (o->pc != NULL)
+		o->pc = perfctr_open(&pc) ? &pc : NULL;
+	    while ((i = __sync_fetch_and_add(next, 1)) < n) {
+		before = errors;
+		eval_trace(traces[i], i, o, libc_stats ? &libc_stats[i] : NULL,
+			   &mm_stats[i]);
+		send_stats(fd[1], i, errors - before, 
+			   libc_stats ? &libc_stats[i] : NULL, &mm_stats[i]);
+	    }
+	    fflush(stdout);
+	    _exit(0);
+	}
+	close(fd[1]);
+	fds[w] = fd[0];
+    }
+
+    /* A worker blocked on a full pipe waits for its turn to be read */
+    for (w = 0; w < workers; w++) {
+	while (recv_stats(fds[w], libc_stats, mm_stats))
+	    ;
+	close(fds[w]);
+	if (waitpid(pids[w], &status, 0) < 0 || 
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    app_error("A worker failed");
+    }
+    free(fds);
+    free(pids);
+    munmap(next, sizeof(int));
+}
+
+/*****************************************************************
+ * Multi-threaded replay (-j). Every thread replays a private copy
+ * of one of the traces, and all of them share one allocator. The mm
+ * package is not thread-safe, so each of its calls holds mm_lock;
+ * libc malloc does its own locking.
+ ****************************************************************/
+
+/* Runs per thread count; the fastest one is reported */
+#define SCALE_RUNS 3
+
+/* Serializes the calls into the mm package from replay threads */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Per-thread state of a multi-threaded replay */
+typedef struct {
+    trace_t trace;              /* a trace, with private id arrays */
+    int use_mm;                 /* replay on mm (1) or libc (0)? */
+    pthread_barrier_t *start;   /* releases all threads at once */
+    double t0, t1;              /* when this thread started and finished */
+} replica_t;
+
+/*
+ * wall_secs - the current time in seconds, for timing several threads
+ *     at once (fsecs only times the calling thread's function)
+ */
+static double wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * replay_thread - body of one replay thread. Waits for the others at
+ *     the start barrier, then replays its trace once.
+ */
+static void *replay_thread(void *ptr)
+{
+    replica_t *r = (replica_t *)ptr;
+    trace_t *trace = &r->trace;
+    cursor_t cur;
+    traceop_t *op;
+    mm_arena_t *arena = NULL;
+    char *p = NULL;
+    int j;
+
+    if (r->use_mm && trace->uses_arena) {
+	pthread_mutex_lock(&mm_lock);
+	arena = mm_arena_create(0);
+	pthread_mutex_unlock(&mm_lock);
+	if (arena == NULL)
+	    app_error("mm_arena_create failed in replay_thread");
+    }
+    trace->num_arena_live = 0;
+    pthread_barrier_wait(r->start);
+
+    r->t0 = wall_secs();
+    start_ops(&cur, trace);
+    while ((op = next_op(&cur)) != NULL) {
+	if (r->use_mm)
+	    pthread_mutex_lock(&mm_lock);
+	switch (op->type) {
+
+	case ALLOC: /* malloc */
+	    p = r->use_mm ? mm_malloc(op->size) : malloc(op->size);
+	    break;
+
+	case REALLOC: /* realloc */
+	    p = trace->blocks[op->index];
+	    p = r->use_mm ? mm_realloc(p, op->size) : realloc(p, op->size);
+	    break;
+
+	case FREE: /* free */
+	    if (r->use_mm)
+		mm_free(trace->blocks[op->index]);
+	    else
+		free(trace->blocks[op->index]);
+	    break;
+
+	case ARENA_ALLOC: /* arena alloc, emulated on libc */
+	    if (r->use_mm)
+		p = mm_arena_alloc(arena, op->size);
+	    else {
+		p = malloc(op->size);
+		trace->arena_ids[trace->num_arena_live++] = op->index;
+	    }
+	    break;
+
+	case ARENA_RESET: /* arena reset, emulated on libc */
+	    if (r->use_mm)
+		mm_arena_reset(arena);
+	    else {
+		for (j = 0; j < trace->num_arena_live; j++)
+		    free(trace->blocks[trace->arena_ids[j]]);
+		trace->num_arena_live = 0;
+	    }
+	    break;
+	}
+	if (r->use_mm)
+	    pthread_mutex_unlock(&mm_lock);
+
+	if (op->type != FREE && op->type != ARENA_RESET) {
+	    if (p == NULL)
+		app_error("allocation failed in replay_thread");
+	    trace->blocks[op->index] = p;
+	}
+    }
+    r->t1 = wall_secs();
+    return NULL;
+}
+
+/*
+ * time_replicas - replay r[0..n-1] concurrently SCALE_RUNS times and
+ *     return the best wall-clock time, from the first thread starting
+ *     to the last one finishing. The per-thread times of that run are
+ *     left in secs[0..n-1].
+ */
+static double time_replicas(replica_t *r, int n, int use_mm, double *secs)
+{
+    pthread_barrier_t start;
+    pthread_t *tids;
+    double t0, t1, best = DBL_MAX;
+    int run, k;
+
+    if ((tids = (pthread_t *)malloc(n * sizeof(pthread_t))) == NULL)
+	unix_error("malloc failed in time_replicas");
+    for (run = 0; run < SCALE_RUNS; run++) {
+	if (use_mm) {
+	    mem_reset_brk();
+	    if (mm_init() < 0)
+		app_error("mm_init failed in time_replicas");
+	}
+	pthread_barrier_init(&start, NULL, n + 1);
+	for (k = 0; k < n; k++) {
+	    r[k].use_mm = use_mm;
+	    r[k].start = &start;
+	    if (pthread_create(&tids[k], NULL, replay_thread, &r[k]) != 0)
+		unix_error("pthread_create failed in time_replicas");
+	}
+	pthread_barrier_wait(&start);
+	for (k = 0; k < n; k++)
+	    pthread_join(tids[k], NULL);
+	pthread_barrier_destroy(&start);
+
+	t0 = DBL_MAX;
+	t1 = 0;
+	for (k = 0; k < n; k++) {
+	    t0 = (r[k].t0 < t0) ? r[k].t0 : t0;
+	    t1 = (r[k].t1 > t1) ? r[k].t1 : t1;
+	}
+	if (t1 - t0 < best) {
+	    best = t1 - t0;
+	    for (k = 0; k < n; k++)
+		secs[k] = r[k].t1 - r[k].t0;
+	}
+    }
+    free(tids);
+    return best;
+}
+
+/*
+ * run_scaling - replay the traces on 1, 2, 4, ... max_threads threads,
+ *     thread k taking trace k mod num_tracefiles, and print aggregate
+ *     and per-thread throughput. Efficiency compares the wall time with
+ *     the ideal one, where every thread runs as fast as its trace does
+ *     alone. The traces are the ones main loaded.
+ */
+static void run_scaling(trace_t **traces, int num_tracefiles, 
+			int max_threads, int use_mm)
+{
+    replica_t *r;
+    double *solo, *secs;
+    double wall, ideal, ops, rate, lo, hi, sum;
+    int i, k, n, num_traces;
+
+    num_traces = (num_tracefiles < max_threads) ? num_tracefiles : max_threads;
+    if ((r = (replica_t *)calloc(max_threads, sizeof(replica_t))) == NULL ||
+	(solo = (double *)malloc(num_traces * sizeof(double))) == NULL ||
+	(secs = (double *)malloc(max_threads * sizeof(double))) == NULL)
+	unix_error("malloc failed in run_scaling");
+
+    /* Threads share the requests of a trace but not its id arrays */
+    for (k = 0; k < max_threads; k++) {
+	r[k].trace = *traces[k % num_traces];
+	if ((r[k].trace.blocks = (char **)
+	     malloc(r[k].trace.max_ids * sizeof(char *))) == NULL ||
+	    (r[k].trace.arena_ids = (int *)
+	     malloc(r[k].trace.max_ids * sizeof(int))) == NULL)
+	    unix_error("malloc failed in run_scaling");
+    }
+
+    /* Time each trace alone, for the ideal wall times */
+    for (i = 0; i < num_traces; i++)
+	solo[i] = time_replicas(&r[i], 1, use_mm, secs);
+
+    printf("\nScaling of %s malloc on up to %d threads:\n", 
+	   use_mm ? "mm" : "libc", max_threads);
+    printf("%7s%10s%10s%10s%10s%10s%6s\n", "threads", "secs", "Kops",
+	   "min Kops", "avg Kops", "max Kops", "eff");
+    for (n = 1; ; n = (2 * n < max_threads) ? 2 * n : max_threads) {
+	wall = time_replicas(r, n, use_mm, secs);
+	ops = sum = ideal = 0;
+	lo = DBL_MAX;
+	hi = 0;
+	for (k = 0; k < n; k++) {
+	    ops += r[k].trace.num_ops;
+	    rate = r[k].trace.num_ops / secs[k];
+	    sum += rate;
+	    lo = (rate < lo) ? rate : lo;
+	    hi = (rate > hi) ? rate : hi;
+	    if (solo[k % num_traces] > ideal)
+		ideal = solo[k % num_traces];
+	}
+	printf("%7d%10.6f%10.0f%10.0f%10.0f%10.0f%5.0f%%\n", n, wall,
+	       (ops/1e3)/wall, lo/1e3, (sum/n)/1e3, hi/1e3,
+	       100.0 * ideal / wall);
+	if (n == max_threads)
 	    break;
+    }
+
+    for (k = 0; k < max_threads; k++) {
+	free(r[k].trace.blocks);
+	free(r[k].trace.arena_ids);
+    }
+    free(r);
+    free(solo);
+    free(secs);
+}
+
+/***********************************************************
+ * Builtin microbenchmarks for the allocator extension APIs
+ **********************************************************/
+
+/* Shape of the request-scoped arena workload */
+#define BENCH_REQUESTS  2000 /* request cycles per run */
+#define BENCH_OBJS        64 /* scratch objects per request */
+#define BENCH_MAXSIZE    256 /* largest scratch object in bytes */
+
+/* Shape of the object pool workload */
+#define BENCH_POOL_OBJS 4096 /* objects live at the peak of a round */
+#define BENCH_POOL_ROUNDS 16 /* allocate-all/free-all rounds per run */
+
+/* Shape of the page map lookup workload */
+#define BENCH_PM_PAGES  4096 /* registered pages */
+#define BENCH_PM_LOOKUPS (1<<20) /* lookups per run */
+
+/* Holds the params to the bench_xxx functions, which are timed by fsecs */
+typedef struct {
+    int *sizes;     /* size of each object in a request cycle */
+    char **objs;    /* the objects allocated in the current cycle */
+    int obj_size;   /* object size for the pool benchmark */
+    int align;      /* object alignment for the pool benchmark, or 0 */
+} bench_t;
+
+/*
+ * bench_arena_free - request-scoped workload where every scratch object
+ *     is released individually with mm_free
+ */
+static void bench_arena_free(void *ptr)
+{
+    bench_t *b = (bench_t *)ptr;
+    int r, j;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in bench_arena_free");
+    for (r = 0; r < BENCH_REQUESTS; r++) {
+	for (j = 0; j < BENCH_OBJS; j++)
+	    if ((b->objs[j] = mm_malloc(b->sizes[j])) == NULL)
+		app_error("mm_malloc failed in bench_arena_free");
+	for (j = 0; j < BENCH_OBJS; j++)
+	    mm_free(b->objs[j]);
+    }
+}
+
+/*
+ * bench_arena_reset - the same workload, with the scratch objects
+ *     allocated from an arena that is reset at the end of each request
+ */
+static void bench_arena_reset(void *ptr)
+{
+    bench_t *b = (bench_t *)ptr;
+    mm_arena_t *arena;
+    int r, j;
+
+    mem_reset_brk();
+    if (mm_init() < 0 || (arena = mm_arena_create(0)) == NULL)
+	app_error("mm_init failed in bench_arena_reset");
+    for (r = 0; r < BENCH_REQUESTS; r++) {
+	for (j = 0; j < BENCH_OBJS; j++)
+	    if ((b->objs[j] = mm_arena_alloc(arena, b->sizes[j])) == NULL)
+		app_error("mm_arena_alloc failed in bench_arena_reset");
+	mm_arena_reset(arena);
+    }
+    mm_arena_destroy(arena);
+}
+
+/*
+ * bench_pool_mm - allocate and free a set of same-size objects with
+ *     mm_malloc (or mm_memalign)/mm_free, freeing every other object
+ *     first so that the free pattern is not simply LIFO
+ */
+static void bench_pool_mm(void *ptr)
+{
+    bench_t *b = (bench_t *)ptr;
+    int r, j;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in bench_pool_mm");
+    for (r = 0; r < BENCH_POOL_ROUNDS; r++) {
+	for (j = 0; j < BENCH_POOL_OBJS; j++)
+	    if ((b->objs[j] = b->align > 0 ? 
+		 mm_memalign(b->align, b->obj_size) : 
+		 mm_malloc(b->obj_size)) == NULL)
+		app_error("mm_malloc failed in bench_pool_mm");
+	for (j = 0; j < BENCH_POOL_OBJS; j += 2)
+	    mm_free(b->objs[j]);
+	for (j = 1; j < BENCH_POOL_OBJS; j += 2)
+	    mm_free(b->objs[j]);
+    }
+}
+
+/*
+ * bench_pool_pool - the same workload on an mm_pool of that size and
+ *     alignment, checking that every object is aligned
+ */
+static void bench_pool_pool(void *ptr)
+{
+    bench_t *b = (bench_t *)ptr;
+    mm_pool_t *pool;
+    int r, j;
+
+    mem_reset_brk();
+    if (mm_init() < 0 || 
+	(pool = mm_pool_create(b->obj_size, b->align)) == NULL)
+	app_error("mm_init failed in bench_pool_pool");
+    for (r = 0; r < BENCH_POOL_ROUNDS; r++) {
+	for (j = 0; j < BENCH_POOL_OBJS; j++) {
+	    if ((b->objs[j] = mm_pool_alloc(pool)) == NULL)
+		app_error("mm_pool_alloc failed in bench_pool_pool");
+	    if (b->align > 0 && ((size_t)b->objs[j] & (b->align - 1)))
+		app_error("misaligned object in bench_pool_pool");
+	}
+	for (j = 0; j < BENCH_POOL_OBJS; j += 2)
+	    mm_pool_free(pool, b->objs[j]);
+	for (j = 1; j < BENCH_POOL_OBJS; j += 2)
+	    mm_pool_free(pool, b->objs[j]);
+    }
+    mm_pool_destroy(pool);
+}
+
+/*
+ * bench_pagemap - look up pseudo-random addresses spread over a range
+ *     of registered pages
+ */
+static void bench_pagemap(void *ptr)
+{
+    char *base = (char *)((bench_t *)ptr)->objs[0];
+    unsigned x = 1;
+    int i;
+
+    for (i = 0; i < BENCH_PM_LOOKUPS; i++) {
+	x = x * 1103515245 + 12345;
+	if (mm_pagemap_get(base + (x >> 4) % (BENCH_PM_PAGES * PM_PAGESIZE)) == NULL)
+	    app_error("unregistered page in bench_pagemap");
+    }
+}
+
+/*
+ * run_bench - run the builtin microbenchmark called name and print
+ *     the throughput of each variant
+ */
+static void run_bench(char *name)
+{
+    bench_t b;
+    double secs, ops;
+    int j;
+
+    if ((b.sizes = (int *)malloc(BENCH_OBJS * sizeof(int))) == NULL ||
+	(b.objs = (char **)malloc(BENCH_POOL_OBJS * sizeof(char *))) == NULL)
+	unix_error("malloc failed in run_bench");
+    srand(1);
+    for (j = 0; j < BENCH_OBJS; j++)
+	b.sizes[j] = 1 + rand() % BENCH_MAXSIZE;
+
+    if (!strcmp(name, "arena")) {
+	ops = (double)BENCH_REQUESTS * BENCH_OBJS;
+	printf("Request-scoped workload: %d requests of %d objects\n",
+	       BENCH_REQUESTS, BENCH_OBJS);
+	printf("%-10s%10s%8s\n", "method", "secs", "Kops");
+	secs = fsecs(bench_arena_free, &b);
+	printf("%-10s%10.6f%8.0f\n", "mm_free", secs, (ops/1e3)/secs);
+	secs = fsecs(bench_arena_reset, &b);
+	printf("%-10s%10.6f%8.0f\n", "arena", secs, (ops/1e3)/secs);
+    }
+    else if (!strcmp(name, "pool")) {
+	ops = 2.0 * BENCH_POOL_ROUNDS * BENCH_POOL_OBJS;
+	printf("Object pool workload: %d rounds of %d objects\n",
+	       BENCH_POOL_ROUNDS, BENCH_POOL_OBJS);
+	printf("%6s%6s%10s%8s%10s%8s%8s\n", "size", "align",
+	       "mm secs", "Kops", "pool secs", "Kops", "speedup");
+	/* the last rows ask for more than cache line alignment */
+	for (j = 0; j < 10; j++) {
+	    double mm_secs;
+
+	    b.obj_size = j < 8 ? 8 << j : 64 << (j - 8);
+	    b.align = j < 8 ? 0 : 256;
+	    mm_secs = fsecs(bench_pool_mm, &b);
+	    secs = fsecs(bench_pool_pool, &b);
+	    printf("%6d%6d%10.6f%8.0f%10.6f%8.0f%7.1fx\n", b.obj_size,
+		   b.align, mm_secs, (ops/1e3)/mm_secs, secs, 
+		   (ops/1e3)/secs, mm_secs/secs);
 	}
     }
+    else if (!strcmp(name, "pagemap")) {
+	pm_owner_t owner;
+
+	mem_reset_brk();
+	if (mm_init() < 0 || 
+	    (b.objs[0] = mm_memalign(PM_PAGESIZE, BENCH_PM_PAGES * PM_PAGESIZE)) == NULL)
+	    app_error("mm_memalign failed in run_bench");
+	mm_pagemap_set(b.objs[0], BENCH_PM_PAGES * PM_PAGESIZE, &owner);
+	secs = fsecs(bench_pagemap, &b);
+	printf("Page map: %d lookups over %d pages\n", 
+	       BENCH_PM_LOOKUPS, BENCH_PM_PAGES);
+	printf("%.2f ns per lookup\n", secs * 1e9 / BENCH_PM_LOOKUPS);
+	mm_pagemap_reset();
+    }
+    else {
+	sprintf(msg, "Unknown benchmark %s", name);
+	app_error(msg);
+    }
+    free(b.sizes);
+    free(b.objs);
 }
 
 /*************************************
@@ -972,6 +3387,674 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printtimeline - Print the fragmentation timeline of each trace, then
+ *     its time-weighted utilization and the point of most waste
+ */
+static void printtimeline(int n, stats_t *stats)
+{
+    timeline_t *tl;
+    frag_sample_t *s, *worst;
+    int i, k;
+
+    for (i = 0; i < n; i++) {
+	tl = &stats[i].tl;
+	if (!stats[i].valid || tl->n == 0)
+	    continue;
+	printf("Fragmentation of trace %d, every %d requests:\n", 
+	       i, tl->every);
+	printf("%9s%11s%11s%11s%11s%11s%6s\n", "op", "live", "heap", 
+	       "internal", "external", "largest", "util");
+	for (k = 0; k < tl->n; k++) {
+	    s = &tl->s[k];
+	    printf("%9d%11lu%11lu%11lu%11lu%11lu%5.0f%%\n", s->op,
+		   (unsigned long)s->live, (unsigned long)s->heap, 
+		   (unsigned long)s->internal, (unsigned long)s->external, 
+		   (unsigned long)s->largest, 
+		   s->heap ? 100.0 * s->live / s->heap : 0.0);
+	}
+	printf("\n");
+    }
+
+    printf("Fragmentation over time (avg = time-weighted utilization):\n");
+    printf("%5s%6s%6s%10s%11s%11s%6s\n", "trace", "peak", "avg", 
+	   "worst op", "live", "heap", "util");
+    for (i = 0; i < n; i++) {
+	tl = &stats[i].tl;
+	if (!stats[i].valid || tl->n == 0) {
+	    printf("%2d%9s%6s%10s%11s%11s%6s\n", i, "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%8.0f%%%5.0f%%", i, stats[i].util * 100.0, 
+	       timeline_summary(tl, &worst) * 100.0);
+	printf("%10d%11lu%11lu%5.0f%%\n", worst->op, 
+	       (unsigned long)worst->live, (unsigned long)worst->heap,
+	       100.0 * worst->live / worst->heap);
+    }
+}
+
+/*
+ * printtouch - Print the time of the touch replay of each trace, next
+ *     to the time of the plain replay, for libc (if it was run) and mm
+ */
+static void printtouch(int n, stats_t *libc_stats, stats_t *mm_stats,
+		       double touch)
+{
+    stats_t *st;
+    int i, k;
+
+    printf("Replay touching %.0f%% of each payload:\n", touch * 100.0);
+    printf("%5s%8s%10s%10s%8s%8s\n", "trace", "malloc", "secs", 
+	   "touched", "Kops", "ratio");
+    for (k = 0; k < 2; k++) {
+	if ((st = k ? mm_stats : libc_stats) == NULL)
+	    continue;
+	for (i = 0; i < n; i++) {
+	    if (!st[i].valid) {
+		printf("%2d%11s%10s%10s%8s%8s\n", i, k ? "mm" : "libc", 
+		       "-", "-", "-", "-");
+		continue;
+	    }
+	    printf("%2d%11s%10.6f%10.6f%8.0f%8.2f\n", i, k ? "mm" : "libc", 
+		   st[i].secs, st[i].touch_secs, 
+		   (st[i].ops/1e3)/st[i].touch_secs, 
+		   st[i].touch_secs / st[i].secs);
+	}
+    }
+}
+
+/*
+ * printoverhead - Print how much of the time of each trace the replay
+ *     itself accounts for, and the throughput of mm without it (-I)
+ */
+static void printoverhead(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Replay overhead (the replay on a null allocator):\n");
+    printf("%5s%10s%10s%8s%10s\n", "trace", "secs", "replay", "share", 
+	   "net Kops");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	printf("%5d%10.6f%10.6f%7.1f%%", i, stats[i].secs, stats[i].null_secs,
+	       100.0 * stats[i].null_secs / stats[i].secs);
+	if (stats[i].secs > stats[i].null_secs)
+	    printf("%10.0f\n", (stats[i].ops/1e3) / 
+		   (stats[i].secs - stats[i].null_secs));
+	else
+	    printf("%10s\n", "-");
+    }
+}
+
+/*
+ * printopen - Print the open-loop rate and the service and response
+ *     time percentiles of each timed trace
+ */
+static void printopen(int n, stats_t *stats, double scale, 
+		      unsigned long long overhead)
+{
+    hist_t *h;
+    int i, t;
+
+    printf("Open-loop replay at %gx the gaps, in ns (timer overhead of "
+	   "%llu ns subtracted):\n", scale, overhead);
+    printf("%5s%8s%7s %-9s%8s%8s%8s%8s%9s\n", "trace", "Kops", "late",
+	   "time", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+	if (stats[i].open == NULL) {
+	    if (stats[i].valid)
+		printf("%5d%8s\n", i, "untimed");
+	    continue;
+	}
+	for (t = 0; t < 2; t++) {
+	    h = &stats[i].open[t];
+	    if (t == 0)
+		printf("%5d%8.0f%6.1f%% %-9s", i, stats[i].offered / 1e3, 
+		       stats[i].late * 100.0, "service");
+	    else
+		printf("%5s%8s%7s %-9s", "", "", "", "response");
+	    printf("%8llu%8llu%8llu%8llu%9llu\n", hist_percentile(h, 50),
+		   hist_percentile(h, 90), hist_percentile(h, 99),
+		   hist_percentile(h, 99.9), h->max);
+	}
+    }
+}
+
+/*
+ * printmix - Print the results of the mix (-M) beside those of each
+ *     trace on a heap of its own. A tenant's util is its share of the
+ *     live bytes at the mix's peak, so the tenants add up to the mix.
+ */
+static void printmix(mix_t *mix, stats_t *mm_stats)
+{
+    stats_t *t;
+    int i;
+
+    printf("Mix of the traces on one heap (%s), beside each on its own:\n",
+	   !mix->random ? "round-robin" : 
+	   mix->weights ? "random by weight" : "random by requests left");
+    if (!mix->stats.valid) {
+	printf("the mix is not valid\n");
+	return;
+    }
+    printf("%5s%8s%6s%10s%7s%7s%7s\n", "trace", "ops", "util", "secs", 
+	   "Kops", "alone", "Kops");
+    for (i = 0; i < mix->n; i++) {
+	t = &mix->tenants[i];
+	printf("%5d%8.0f%5.0f%%%10.6f%7.0f", i, t->ops, t->util * 100.0, 
+	       t->secs, (t->ops/1e3) / t->secs);
+	if (mm_stats[i].valid)
+	    printf("%6.0f%%%7.0f\n", mm_stats[i].util * 100.0,
+		   (mm_stats[i].ops/1e3) / mm_stats[i].secs);
+	else
+	    printf("%7s%7s\n", "-", "-");
+    }
+    printf("%5s%8.0f%5.0f%%%10.6f%7.0f\n", "mix", mix->stats.ops, 
+	   mix->stats.util * 100.0, mix->stats.secs, 
+	   (mix->stats.ops/1e3) / mix->stats.secs);
+}
+
+/*
+ * printloss - Print where each trace's heap went at its peak
+ */
+static void printloss(int n, stats_t *stats)
+{
+    loss_t *l;
+    int i;
+
+    printf("Heap at the peak of the live bytes, in percent of the peak heap:\n");
+    printf("%5s%10s%6s%6s%8s%6s%6s%6s\n", "trace", "op", "util", "tags",
+	   "padding", "slack", "free", "other");
+    for (i = 0; i < n; i++) {
+	l = &stats[i].loss;
+	if (!stats[i].valid || !stats[i].accounted) {
+	    printf("%2d%13s%6s%6s%8s%6s%6s%6s\n", i, "-", "-", "-", "-", "-",
+		   "-", "-");
+	    continue;
+	}
+	printf("%2d%13d%5.1f%%%5.1f%%%7.1f%%%5.1f%%%5.1f%%%5.1f%%\n", i, l->op,
+	       stats[i].util * 100.0, l->tags * 100.0, l->padding * 100.0,
+	       l->slack * 100.0, l->free * 100.0, l->other * 100.0);
+    }
+}
+
+/*
+ * printlatency - Print the latency percentiles of each request type
+ *     on each trace
+ */
+static void printlatency(int n, stats_t *stats, unsigned long long overhead)
+{
+    hist_t *h;
+    int i, t;
+
+    printf("Request latency in ns (timer overhead of %llu ns subtracted):\n",
+	   overhead);
+    printf("%5s %-8s%9s%8s%8s%8s%8s%9s\n", 
+	   "trace", "request", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+	if (stats[i].lat == NULL)
+	    continue;
+	for (t = 0; t < NUM_OPTYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->total == 0)
+		continue;
+	    printf("%5d %-8s%9llu%8llu%8llu%8llu%8llu%9llu\n", i, opnames[t],
+		   h->total, hist_percentile(h, 50), hist_percentile(h, 90),
+		   hist_percentile(h, 99), hist_percentile(h, 99.9), h->max);
+	}
+    }
+}
+
+/*
+ * printcounters - Print the hardware counts per request of each trace,
+ *     and their average over all requests
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    double total[PC_NUM], ops = 0;
+    int i, k;
+
+    printf("%5s", "trace");
+    for (k = 0; k < PC_NUM; k++) {
+	printf("%10s", perfctr_name(k));
+	total[k] = 0;
+    }
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].counted)
+	    continue;
+	printf("%5d", i);
+	for (k = 0; k < PC_NUM; k++) {
+	    if (stats[i].ctr[k] < 0)
+		printf("%10s", "-");
+	    else
+		printf("%10.2f", stats[i].ctr[k]);
+	    total[k] += stats[i].ctr[k] * stats[i].ops;
+	}
+	printf("\n");
+	ops += stats[i].ops;
+    }
+    if (ops > 0) {
+	printf("%5s", "Total");
+	for (k = 0; k < PC_NUM; k++) {
+	    if (total[k] < 0)
+		printf("%10s", "-");
+	    else
+		printf("%10.2f", total[k] / ops);
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printrobust - Print the median running time of each trace with its
+ *     confidence interval and the number of runs it took (-R)
+ */
+static void printrobust(int n, stats_t *stats)
+{
+    int i;
+    robust_t *r;
+
+    printf("%5s%11s%9s%9s%6s%9s\n", 
+	   "trace", "median", "CI-", "CI+", "runs", "outliers");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	r = &stats[i].rob;
+	printf("%5d%11.6f%8.2f%%%8.2f%%%6d%9d\n", i, r->median,
+	       100.0 * (r->median - r->lo) / r->median,
+	       100.0 * (r->hi - r->median) / r->median,
+	       r->runs, r->outliers);
+    }
+}
+
+/*
+ * write_baseline - Save the utilization and throughput of each trace
+ *     to path, one "<trace> <util> <Kops>" line per trace
+ */
+static void write_baseline(char *path, char **tracefiles, int n, 
+			   stats_t *stats)
+{
+    FILE *f;
+    int i;
+
+    if ((f = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open baseline %s for writing", path);
+	unix_error(msg);
+    }
+    fprintf(f, "# mdriver baseline: trace util Kops\n");
+    for (i = 0; i < n; i++)
+	if (stats[i].valid)
+	    fprintf(f, "%s %.6f %.3f\n", tracefiles[i], stats[i].util,
+		    (stats[i].ops/1e3)/stats[i].secs);
+    if (fclose(f) != 0)
+	unix_error("Could not write the baseline");
+}
+
+/*
+ * check_baseline - Compare each trace with its line in the baseline at
+ *     path, and return the number of traces whose throughput or
+ *     utilization fell by more than ROBUST_REGRESSION. Under -R, the
+ *     throughput is taken at the fast end of its confidence interval,
+ *     so that noise alone does not count as a regression.
+ */
+static int check_baseline(char *path, char **tracefiles, int n, 
+			  stats_t *stats)
+{
+    FILE *f;
+    char line[MAXLINE], name[MAXLINE];
+    double base_util, base_kops, kops;
+    int i, found, regressions = 0;
+
+    if ((f = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open baseline %s", path);
+	unix_error(msg);
+    }
+    printf("%5s%8s%8s%10s%10s\n", "trace", "util", "base", "Kops", "base");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	found = 0;
+	rewind(f);
+	while (fgets(line, MAXLINE, f) != NULL)
+	    if (sscanf(line, "%s %lf %lf", name, &base_util, &base_kops) == 3 &&
+		!strcmp(name, tracefiles[i])) {
+		found = 1;
+		break;
+	    }
+	if (!found) {
+	    printf("%5d  %s is not in the baseline\n", i, tracefiles[i]);
+	    continue;
+	}
+	kops = (stats[i].ops/1e3) / (robust ? stats[i].rob.lo : stats[i].secs);
+	printf("%5d%7.1f%%%7.1f%%%10.0f%10.0f", i, stats[i].util*100.0,
+	       base_util*100.0, kops, base_kops);
+	if (stats[i].util < base_util * (1 - ROBUST_REGRESSION) ||
+	    kops < base_kops * (1 - ROBUST_REGRESSION)) {
+	    printf("  REGRESSION");
+	    regressions++;
+	}
+	printf("\n");
+    }
+    fclose(f);
+    return regressions;
+}
+
+/*
+ * get_meta - Describe the machine, build and run that produced the
+ *     results, so that results from different machines can be compared
+ */
+static void get_meta(meta_t *m)
+{
+    FILE *f;
+    char line[MAXLINE], *p;
+    time_t t = time(NULL);
+
+    strcpy(m->cpu, "unknown");
+    if ((f = fopen("/proc/cpuinfo", "r")) != NULL) {
+	while (fgets(line, MAXLINE, f) != NULL)
+	    if (!strncmp(line, "model name", 10) && 
+		(p = strchr(line, ':')) != NULL) {
+		for (p++; *p == ' '; p++)
+		    ;
+		p[strcspn(p, "\n")] = '\0';
+		strcpy(m->cpu, p);
+		break;
+	    }
+	fclose(f);
+    }
+    m->ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (gethostname(m->host, MAXLINE) < 0)
+	strcpy(m->host, "unknown");
+    m->host[MAXLINE-1] = '\0';
+    strftime(m->date, MAXLINE, "%Y-%m-%dT%H:%M:%S%z", localtime(&t));
+#if USE_TSC
+    m->timer = "tsc";
+#elif USE_FCYC
+    m->timer = "fcyc";
+#elif USE_ITIMER
+    m->timer = "itimer";
+#else
+    m->timer = "gettimeofday";
+#endif
+}
+
+/*
+ * json_string - Print s as a JSON string
+ */
+static void json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(f, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(f, "\\u%04x", *s);
+	else
+	    fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/*
+ * json_stats - Print the results of one backend on one trace as a
+ *     JSON object, with the optional measurements that were made
+ */
+static void json_stats(FILE *f, char *backend, int i, char *file, 
+		       stats_t *st)
+{
+    hist_t *h;
+    frag_sample_t *s, *worst;
+    double util;
+    int k, sep;
+
+    fprintf(f, "    {\"backend\": \"%s\", \"trace\": %d, \"file\": ", backend, i);
+    json_string(f, file);
+    fprintf(f, ", \"valid\": %s", st->valid ? "true" : "false");
+    if (!st->valid) {
+	fprintf(f, "}");
+	return;
+    }
+    fprintf(f, ", \"ops\": %.0f, \"secs\": %.9f, \"kops\": %.3f", 
+	    st->ops, st->secs, (st->ops/1e3)/st->secs);
+    if (strcmp(backend, "libc"))
+	fprintf(f, ", \"util\": %.6f, \"sbrks\": %d", st->util, st->sbrks);
+    if (st->rob.runs > 0)
+	fprintf(f, ",\n     \"robust\": {\"median\": %.9f, \"ci_lo\": %.9f, "
+		"\"ci_hi\": %.9f, \"runs\": %d, \"outliers\": %d}",
+		st->rob.median, st->rob.lo, st->rob.hi, st->rob.runs, 
+		st->rob.outliers);
+    if (st->counted) {
+	fprintf(f, ",\n     \"counters_per_op\": {");
+	for (k = 0; k < PC_NUM; k++) {
+	    fprintf(f, "%s\"%s\": ", k ? ", " : "", perfctr_name(k));
+	    if (st->ctr[k] < 0)
+		fprintf(f, "null");
+	    else
+		fprintf(f, "%.3f", st->ctr[k]);
+	}
+	fprintf(f, "}");
+    }
+    if (st->lat != NULL) {
+	fprintf(f, ",\n     \"latency_ns\": {");
+	for (k = sep = 0; k < NUM_OPTYPES; k++) {
+	    h = &st->lat[k];
+	    if (h->total == 0)
+		continue;
+	    fprintf(f, "%s\n       \"%s\": {\"count\": %llu, \"p50\": %llu, "
+		    "\"p90\": %llu, \"p99\": %llu, \"p99.9\": %llu, "
+		    "\"max\": %llu}", sep++ ? "," : "", opnames[k], h->total,
+		    hist_percentile(h, 50), hist_percentile(h, 90),
+		    hist_percentile(h, 99), hist_percentile(h, 99.9), h->max);
+	}
+	fprintf(f, "}");
+    }
+    if (st->touch_secs > 0)
+	fprintf(f, ",\n     \"touch_secs\": %.9f, \"touch_kops\": %.3f",
+		st->touch_secs, (st->ops/1e3)/st->touch_secs);
+    if (st->null_secs > 0)
+	fprintf(f, ",\n     \"null_secs\": %.9f", st->null_secs);
+    if (st->open != NULL) {
+	fprintf(f, ",\n     \"open\": {\"offered_kops\": %.3f, \"late\": %.6f",
+		st->offered / 1e3, st->late);
+	for (k = 0; k < 2; k++) {
+	    h = &st->open[k];
+	    fprintf(f, ",\n       \"%s_ns\": {\"p50\": %llu, \"p90\": %llu, "
+		    "\"p99\": %llu, \"p99.9\": %llu, \"max\": %llu}",
+		    k ? "response" : "service", hist_percentile(h, 50),
+		    hist_percentile(h, 90), hist_percentile(h, 99),
+		    hist_percentile(h, 99.9), h->max);
+	}
+	fprintf(f, "}");
+    }
+    if (st->accounted)
+	fprintf(f, ",\n     \"loss\": {\"op\": %d, \"tags\": %.6f, "
+		"\"padding\": %.6f, \"slack\": %.6f, \"free\": %.6f, "
+		"\"other\": %.6f}", st->loss.op, st->loss.tags, 
+		st->loss.padding, st->loss.slack, st->loss.free, st->loss.other);
+    if (st->tl.n > 0) {
+	util = timeline_summary(&st->tl, &worst);
+	fprintf(f, ",\n     \"timeline\": {\"every\": %d, \"avg_util\": %.6f, "
+		"\"worst\": {\"op\": %d, \"util\": %.6f},\n", st->tl.every,
+		util, worst->op, (double)worst->live / worst->heap);
+	fprintf(f, "       \"columns\": [\"op\", \"live\", \"heap\", "
+		"\"internal\", \"external\", \"largest_free\"],\n"
+		"       \"samples\": [");
+	for (k = 0; k < st->tl.n; k++) {
+	    s = &st->tl.s[k];
+	    fprintf(f, "%s[%d, %lu, %lu, %lu, %lu, %lu]", 
+		    k ? (k % 4 ? ", " : ",\n         ") : "", s->op, 
+		    (unsigned long)s->live, (unsigned long)s->heap, 
+		    (unsigned long)s->internal, (unsigned long)s->external,
+		    (unsigned long)s->largest);
+	}
+	fprintf(f, "]}");
+    }
+    fprintf(f, "}");
+}
+
+/*
+ * print_json - Print the metadata, per-trace results of each backend
+ *     and the summary as one JSON document
+ */
+static void print_json(FILE *f, char **tracefiles, int n, 
+		       stats_t *libc_stats, stats_t *mm_stats, mix_t *mix,
+		       int numcorrect, double perfindex)
+{
+    meta_t m;
+    int i;
+
+    get_meta(&m);
+    fprintf(f, "{\n  \"meta\": {\n    \"cpu\": ");
+    json_string(f, m.cpu);
+    fprintf(f, ",\n    \"ncpus\": %d,\n    \"host\": ", m.ncpus);
+    json_string(f, m.host);
+    fprintf(f, ",\n    \"date\": \"%s\",\n    \"compiler\": ", m.date);
+    json_string(f, __VERSION__);
+    fprintf(f, ",\n    \"cflags\": ");
+    json_string(f, BUILD_CFLAGS);
+    fprintf(f, ",\n    \"revision\": ");
+    json_string(f, BUILD_REV);
+    fprintf(f, ",\n    \"timer\": \"%s\"\n  },\n", m.timer);
+
+    fprintf(f, "  \"results\": [\n");
+    for (i = 0; libc_stats != NULL && i < n; i++) {
+	json_stats(f, "libc", i, tracefiles[i], &libc_stats[i]);
+	fprintf(f, ",\n");
+    }
+    for (i = 0; i < n; i++) {
+	json_stats(f, "mm", i, tracefiles[i], &mm_stats[i]);
+	fprintf(f, "%s\n", (i < n-1 || mix != NULL) ? "," : "");
+    }
+    for (i = 0; mix != NULL && i < n; i++) {
+	json_stats(f, "mix", i, tracefiles[i], &mix->tenants[i]);
+	fprintf(f, ",\n");
+    }
+    if (mix != NULL) {
+	json_stats(f, "mix", -1, "mix", &mix->stats);
+	fprintf(f, "\n");
+    }
+    fprintf(f, "  ],\n  \"summary\": {\"correct\": %d, \"errors\": %d, "
+	    "\"perfidx\": %.1f}\n}\n", numcorrect, errors, perfindex);
+}
+
+/*
+ * csv_stats - Print the results of one backend on one trace as a CSV
+ *     row, leaving the measurements that were not made empty
+ */
+static void csv_stats(FILE *f, char *backend, int i, char *file, 
+		      stats_t *st)
+{
+    hist_t *h;
+    frag_sample_t *worst;
+    double util;
+    int k;
+
+    fprintf(f, "%s,%d,\"%s\",%d", backend, i, file, st->valid);
+    if (!st->valid) {
+	fprintf(f, "\n");
+	return;
+    }
+    fprintf(f, ",%.0f,%.9f,%.3f", st->ops, st->secs, (st->ops/1e3)/st->secs);
+    if (strcmp(backend, "libc"))
+	fprintf(f, ",%.6f,%d", st->util, st->sbrks);
+    else
+	fprintf(f, ",,");
+    if (st->rob.runs > 0)
+	fprintf(f, ",%.9f,%.9f,%d,%d", st->rob.lo, st->rob.hi, 
+		st->rob.runs, st->rob.outliers);
+    else
+	fprintf(f, ",,,,");
+    for (k = 0; k < PC_NUM; k++)
+	if (st->counted && st->ctr[k] >= 0)
+	    fprintf(f, ",%.3f", st->ctr[k]);
+	else
+	    fprintf(f, ",");
+    for (k = 0; k < NUM_OPTYPES; k++) {
+	h = (st->lat != NULL) ? &st->lat[k] : NULL;
+	if (h != NULL && h->total > 0)
+	    fprintf(f, ",%llu,%llu,%llu,%llu,%llu,%llu", h->total,
+		    hist_percentile(h, 50), hist_percentile(h, 90),
+		    hist_percentile(h, 99), hist_percentile(h, 99.9), h->max);
+	else
+	    fprintf(f, ",,,,,,");
+    }
+    if (st->tl.n > 0) {
+	util = timeline_summary(&st->tl, &worst);
+	fprintf(f, ",%.6f,%d,%.6f", util, worst->op, 
+		(double)worst->live / worst->heap);
+    }
+    else
+	fprintf(f, ",,,");
+    if (st->accounted)
+	fprintf(f, ",%d,%.6f,%.6f,%.6f,%.6f,%.6f", st->loss.op, st->loss.tags,
+		st->loss.padding, st->loss.slack, st->loss.free, st->loss.other);
+    else
+	fprintf(f, ",,,,,,");
+    if (st->touch_secs > 0)
+	fprintf(f, ",%.9f", st->touch_secs);
+    else
+	fprintf(f, ",");
+    if (st->null_secs > 0)
+	fprintf(f, ",%.9f", st->null_secs);
+    else
+	fprintf(f, ",");
+    if (st->open != NULL) {
+	fprintf(f, ",%.3f,%.6f", st->offered / 1e3, st->late);
+	for (k = 0; k < 2; k++)
+	    fprintf(f, ",%llu,%llu,%llu,%llu", hist_percentile(&st->open[k], 50),
+		    hist_percentile(&st->open[k], 99),
+		    hist_percentile(&st->open[k], 99.9), st->open[k].max);
+    }
+    else
+	fprintf(f, ",,,,,,,,,,");
+    fprintf(f, "\n");
+}
+
+/*
+ * print_csv - Print the per-trace results of each backend as CSV, one
+ *     row per backend and trace, after "#" comment lines holding the
+ *     metadata and the summary
+ */
+static void print_csv(FILE *f, char **tracefiles, int n, 
+		      stats_t *libc_stats, stats_t *mm_stats, mix_t *mix,
+		      int numcorrect, double perfindex)
+{
+    meta_t m;
+    int i, k;
+
+    get_meta(&m);
+    fprintf(f, "# cpu: %s\n# ncpus: %d\n# host: %s\n# date: %s\n", 
+	    m.cpu, m.ncpus, m.host, m.date);
+    fprintf(f, "# compiler: %s\n# cflags: %s\n# revision: %s\n# timer: %s\n",
+	    __VERSION__, BUILD_CFLAGS, BUILD_REV, m.timer);
+    fprintf(f, "# correct: %d\n# errors: %d\n# perfidx: %.1f\n",
+	    numcorrect, errors, perfindex);
+
+    fprintf(f, "backend,trace,file,valid,ops,secs,kops,util,sbrks,"
+	    "ci_lo,ci_hi,runs,outliers");
+    for (k = 0; k < PC_NUM; k++)
+	fprintf(f, ",%s", perfctr_name(k));
+    for (k = 0; k < NUM_OPTYPES; k++)
+	fprintf(f, ",%s_count,%s_p50,%s_p90,%s_p99,%s_p99.9,%s_max",
+		opnames[k], opnames[k], opnames[k], opnames[k], opnames[k],
+		opnames[k]);
+    fprintf(f, ",avg_util,worst_op,worst_util,peak_op,loss_tags,"
+	    "loss_padding,loss_slack,loss_free,loss_other,touch_secs,null_secs,"
+	    "open_kops,open_late,service_p50,service_p99,service_p99.9,"
+	    "service_max,response_p50,response_p99,response_p99.9,"
+	    "response_max\n");
+    for (i = 0; libc_stats != NULL && i < n; i++)
+	csv_stats(f, "libc", i, tracefiles[i], &libc_stats[i]);
+    for (i = 0; i < n; i++)
+	csv_stats(f, "mm", i, tracefiles[i], &mm_stats[i]);
+    for (i = 0; mix != NULL && i < n; i++)
+	csv_stats(f, "mix", i, tracefiles[i], &mix->tenants[i]);
+    if (mix != NULL)
+	csv_stats(f, "mix", -1, "mix", &mix->stats);
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +4087,36 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVaIlLPRsu] [-f <file>] [-t <dir>] [-b <bench>] [-j <n>]\n"
+	    "               [-B <file>] [-W <file>] [-F <n>] [-D <n,...>] [-T <frac>]\n"
+	    "               [-G <spec>] [-w <n>] [-M <how>] [-O <scale>]\n"
+	    "               [--format=json|csv]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-B <file>  Exit with status 2 if a trace is slower or less utilized than in <file>,\n");
+    fprintf(stderr, "\t           or 3 if the package is incorrect.\n");
+    fprintf(stderr, "\t-b <bench> Run a microbenchmark (arena, pool, pagemap) and exit.\n");
+    fprintf(stderr, "\t-D <n,...> Dump the heap to trace<i>-<n>.heap after request <n>.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as a trace file (may be repeated).\n");
+    fprintf(stderr, "\t-F <n>     Sample the heap's fragmentation every <n> requests.\n");
+    fprintf(stderr, "\t--format=json|csv  Print all results to stdout in that format.\n");
+    fprintf(stderr, "\t-G <spec>  Add a trace generated from <spec> (see gen.h).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-I         Time the replay itself on a null allocator.\n");
+    fprintf(stderr, "\t-j <n>     Measure scaling on 1 to <n> threads (0 = all cores).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of each request type.\n");
+    fprintf(stderr, "\t-M <how>   Also run the traces interleaved on one heap (rr, rand, rand:<w>,...).\n");
+    fprintf(stderr, "\t-O <scale> Replay timed traces open-loop, with their gaps times <scale>.\n");
+    fprintf(stderr, "\t-P         Print hardware counters per request.\n");
+    fprintf(stderr, "\t-R         Time until the median is known to within a confidence interval.\n");
+    fprintf(stderr, "\t-s         Stream the traces from disk instead of loading them.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <frac>  Replay again, touching <frac> of each payload.\n");
+    fprintf(stderr, "\t-u         Break down where the heap's utilization is lost.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <n>     Evaluate the traces on <n> processes (0 = all cores).\n");
+    fprintf(stderr, "\t-W <file>  Write the results to baseline <file>.\n");
 }
@@ -2,6 +2,15 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            Each heap lives in a range of virtual addresses that is
+ *            reserved (but not backed) by mem_heap_create. Pages are
+ *            committed in COMMIT_CHUNK units as mem_heap_sbrk advances
+ *            the brk pointer, and are decommitted again when the heap is
+ *            trimmed. Any number of heaps can exist side by side; the
+ *            original mem_* functions operate on the current heap, which
+ *            is the default heap created by mem_init unless another one
+ *            has been selected with mem_heap_select.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,24 +23,247 @@
 #include "memlib.h"
 #include "config.h"
 
+/* Transparent huge pages are 2 MB on every platform we care about */
+#define THP_SIZE (1UL << 21)
+
+/* Rounds x up to a multiple of a (a must be a power of 2) */
+#define ROUNDUP(x, a) (((unsigned long)(x) + ((a) - 1)) & ~((unsigned long)(a) - 1))
+
+/* 
+ * The state of one simulated heap. The struct itself lives in the
+ * first page of the heap's reservation, so creating a heap never calls
+ * the libc malloc.
+ */
+struct mem_heap {
+    char *start_brk;      /* points to first byte of heap */
+    char *brk;            /* points to last byte of heap */
+    char *max_addr;       /* largest legal heap address */ 
+    char *commit_brk;     /* first byte past the committed pages */
+    char *map_addr;       /* start of the reserved mapping */
+    size_t map_size;      /* size of the reserved mapping */
+    size_t commit_chunk;  /* granularity of commits and decommits */
+    size_t sbrk_count;    /* successful sbrk calls since the last reset */
+    char *peak_brk;       /* highest brk since the last reset */
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_heap_t *mem_default_heap; /* heap created by mem_init */
+static mem_heap_t *mem_cur_heap;     /* heap used by the mem_* wrappers */
+
+/*
+ * mem_heap_create - reserve the address space for a new heap of at
+ *    most reserve bytes. Returns NULL if the reservation fails.
+ */
+mem_heap_t *mem_heap_create(size_t reserve)
+{
+    mem_heap_t *heap;
+    char *map_addr;
+    size_t pagesize = getpagesize();
+    size_t map_size = pagesize + ROUNDUP(reserve, pagesize);
+    size_t commit_chunk = COMMIT_CHUNK;
+
+#if MEM_USE_THP
+    /* over-reserve so that the heap can start on a huge page boundary */
+    map_size += THP_SIZE;
+    commit_chunk = THP_SIZE;
+#endif
+
+    /* reserve the address space we will use to model the available VM */
+    map_addr = mmap(NULL, map_size, PROT_NONE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map_addr == MAP_FAILED)
+	return NULL;
+
+    /* the first page holds the heap record itself */
+    if (mprotect(map_addr, pagesize, PROT_READ | PROT_WRITE) < 0) {
+	munmap(map_addr, map_size);
+	return NULL;
+    }
+    heap = (mem_heap_t *)map_addr;
+    heap->map_addr = map_addr;
+    heap->map_size = map_size;
+    heap->commit_chunk = commit_chunk;
+    heap->start_brk = map_addr + pagesize;
+#if MEM_USE_THP
+    heap->start_brk = (char *)ROUNDUP(heap->start_brk, THP_SIZE);
+#ifdef MADV_HUGEPAGE
+    madvise(heap->start_brk, reserve, MADV_HUGEPAGE);
+#endif
+#endif
+
+    heap->max_addr = heap->start_brk + reserve;  /* max legal heap address */
+    heap->brk = heap->start_brk;                 /* heap is empty initially */
+    heap->commit_brk = heap->start_brk;          /* and nothing is committed */
+    heap->peak_brk = heap->start_brk;
+    heap->sbrk_count = 0;
+    return heap;
+}
+
+/*
+ * mem_heap_destroy - release a heap and all of its pages
+ */
+void mem_heap_destroy(mem_heap_t *heap)
+{
+    if (heap == mem_cur_heap)
+	mem_cur_heap = mem_default_heap;
+    if (heap == mem_default_heap)
+	mem_cur_heap = mem_default_heap = NULL;
+    munmap(heap->map_addr, heap->map_size);
+}
+
+/*
+ * mem_heap_reset_brk - reset the brk pointer of heap to make it empty.
+ *    The committed pages are kept, since the driver resets the heap
+ *    before every timed replay and refaulting them would be measured.
+ */
+void mem_heap_reset_brk(mem_heap_t *heap)
+{
+    heap->brk = heap->start_brk;
+    heap->peak_brk = heap->start_brk;
+    heap->sbrk_count = 0;
+}
+
+/*
+ * mem_commit - make the pages of heap up to (at least) new_brk readable
+ *    and writable. Returns 0 on success and -1 on error.
+ */
+static int mem_commit(mem_heap_t *heap, char *new_brk)
+{
+    char *new_commit;
+
+    if (new_brk <= heap->commit_brk)
+	return 0;
+    new_commit = heap->start_brk + 
+	ROUNDUP(new_brk - heap->start_brk, heap->commit_chunk);
+    if (new_commit > heap->max_addr)
+	new_commit = heap->max_addr;
+    if (mprotect(heap->commit_brk, new_commit - heap->commit_brk,
+		 PROT_READ | PROT_WRITE) < 0)
+	return -1;
+    heap->commit_brk = new_commit;
+    return 0;
+}
+
+/*
+ * mem_decommit - return the pages of heap past new_brk to the kernel,
+ *    keeping the partially used commit chunk that new_brk falls in.
+ */
+static void mem_decommit(mem_heap_t *heap, char *new_brk)
+{
+    char *new_commit = heap->start_brk + 
+	ROUNDUP(new_brk - heap->start_brk, heap->commit_chunk);
+
+    if (new_commit >= heap->commit_brk)
+	return;
+    madvise(new_commit, heap->commit_brk - new_commit, MADV_DONTNEED);
+    mprotect(new_commit, heap->commit_brk - new_commit, PROT_NONE);
+    heap->commit_brk = new_commit;
+}
+
+/* 
+ * mem_heap_sbrk - simple model of the sbrk function. Extends heap by
+ *    incr bytes and returns the start address of the new area. A
+ *    negative incr trims the heap and decommits the pages past the
+ *    new brk.
+ */
+void *mem_heap_sbrk(mem_heap_t *heap, int incr)
+{
+    char *old_brk = heap->brk;
+
+    if (((heap->brk + incr) < heap->start_brk) ||
+	((heap->brk + incr) > heap->max_addr) ||
+	(mem_commit(heap, heap->brk + incr) < 0)) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    heap->brk += incr;
+    heap->sbrk_count++;
+    if (heap->brk > heap->peak_brk)
+	heap->peak_brk = heap->brk;
+    if (incr < 0)
+	mem_decommit(heap, heap->brk);
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_lo_of - return address of the first byte of heap
+ */
+void *mem_heap_lo_of(mem_heap_t *heap)
+{
+    return (void *)heap->start_brk;
+}
+
+/* 
+ * mem_heap_hi_of - return address of the last byte of heap
+ */
+void *mem_heap_hi_of(mem_heap_t *heap)
+{
+    return (void *)(heap->brk - 1);
+}
+
+/*
+ * mem_heap_sbrk_count - returns the number of successful sbrk calls on
+ *    heap since it was created or last reset
+ */
+size_t mem_heap_sbrk_count(mem_heap_t *heap)
+{
+    return heap->sbrk_count;
+}
+
+/*
+ * mem_heap_size - returns the size of heap in bytes
+ */
+size_t mem_heap_size(mem_heap_t *heap)
+{
+    return (size_t)(heap->brk - heap->start_brk);
+}
+
+/*
+ * mem_heap_peak_size - returns the largest size of heap in bytes since
+ *    it was created or last reset, which trimming does not lower
+ */
+size_t mem_heap_peak_size(mem_heap_t *heap)
+{
+    return (size_t)(heap->peak_brk - heap->start_brk);
+}
+
+/*
+ * mem_heap_select - make heap the one used by the mem_* wrappers
+ *    below and return the previously selected heap. Passing NULL
+ *    selects the default heap.
+ */
+mem_heap_t *mem_heap_select(mem_heap_t *heap)
+{
+    mem_heap_t *old = mem_cur_heap;
+
+    mem_cur_heap = (heap != NULL) ? heap : mem_default_heap;
+    return old;
+}
+
+/*
+ * mem_heap_default - return the heap created by mem_init
+ */
+mem_heap_t *mem_heap_default(void)
+{
+    return mem_default_heap;
+}
+
+/************************************************************
+ * The following functions operate on the current heap. They
+ * keep the interface the mm package and the driver expect.
+ ************************************************************/
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    if ((mem_default_heap = mem_heap_create(MAX_HEAP)) == NULL) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_cur_heap = mem_default_heap;
 }
 
 /* 
@@ -39,7 +271,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_heap_destroy(mem_default_heap);
 }
 
 /*
@@ -47,25 +279,15 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_heap_reset_brk(mem_cur_heap);
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ * mem_sbrk - extend (or with a negative incr, trim) the current heap
  */
 void *mem_sbrk(int incr) 
 {
-    char *old_brk = mem_brk;
-
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+    return mem_heap_sbrk(mem_cur_heap, incr);
 }
 
 /*
@@ -73,7 +295,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_heap_lo_of(mem_cur_heap);
 }
 
 /* 
@@ -81,7 +303,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_heap_hi_of(mem_cur_heap);
 }
 
 /*
@@ -89,7 +311,23 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_heap_size(mem_cur_heap);
+}
+
+/*
+ * mem_peaksize() - returns the largest heap size since the reset
+ */
+size_t mem_peaksize()
+{
+    return mem_heap_peak_size(mem_cur_heap);
+}
+
+/*
+ * mem_sbrkcount() - returns the number of sbrk calls since the reset
+ */
+size_t mem_sbrkcount()
+{
+    return mem_heap_sbrk_count(mem_cur_heap);
 }
 
 /*
@@ -7,5 +7,21 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peaksize(void);
+size_t mem_sbrkcount(void);
 size_t mem_pagesize(void);
 
+/* Independent heaps; the functions above operate on the selected one */
+typedef struct mem_heap mem_heap_t;
+
+mem_heap_t *mem_heap_create(size_t reserve);
+void mem_heap_destroy(mem_heap_t *heap);
+void *mem_heap_sbrk(mem_heap_t *heap, int incr);
+void mem_heap_reset_brk(mem_heap_t *heap);
+void *mem_heap_lo_of(mem_heap_t *heap);
+void *mem_heap_hi_of(mem_heap_t *heap);
+size_t mem_heap_size(mem_heap_t *heap);
+size_t mem_heap_peak_size(mem_heap_t *heap);
+size_t mem_heap_sbrk_count(mem_heap_t *heap);
+mem_heap_t *mem_heap_select(mem_heap_t *heap);
+mem_heap_t *mem_heap_default(void);
@@ -38,9 +38,11 @@ ptr-WSIZE-> | Header: size of the block   | A|
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "pagemap.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -89,11 +91,23 @@ team_t team = {
 #define NEXT_BLKP(bp)	((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)	((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* block size mm_malloc uses for a request of size bytes: payload rounded up to DSIZE, plus header and footer */
+#define ASIZE(size)	(((size) <= DSIZE) ? 2*DSIZE : DSIZE * (((size) + (DSIZE) + (DSIZE-1)) / DSIZE))
+
 /* static global scalars */
 static void *firstbp = NULL; /* points to the first block past the prologue after initializing*/
 
+/* debug side table of the size requested for each allocated block, kept only while mm_account is on.
+ * It is an open addressing hash table in its own mmap'd pages, so it never calls malloc (libmm.so is malloc) */
+static int acct_on = 0;
+static unsigned long *acct_keys = NULL; /* block pointers, 0 for an empty slot */
+static size_t *acct_sizes = NULL; /* requested size of each block */
+static size_t acct_cap = 0; /* number of slots, a power of 2 */
+static size_t acct_used = 0; /* number of blocks in the table */
+
 /* PRIVATE STATIC FUNCTIONS */
 /* checks for all cases when a block is freed and performs correct coalesce */
+static void *realloc_block(void *ptr, size_t size);
 static void *coalesce(void *bp) 
 {
 	size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
@@ -190,6 +204,84 @@ static void copy_block(void *src, void *dest)
 	}
 } 
 
+/* used by the accounting functions to find the slot of block bp, or the empty slot where it belongs */
+static size_t acct_slot(void *bp)
+{
+	size_t i = (((unsigned long)bp >> 3) * 2654435761UL) & (acct_cap - 1);
+	while (acct_keys[i] != 0 && acct_keys[i] != (unsigned long)bp)
+		i = (i + 1) & (acct_cap - 1);
+	return i;
+}
+
+/* empties the side table, mapping its first pages if needed */
+static void acct_reset(void)
+{
+	if (acct_keys == NULL) {
+		acct_cap = 1024;
+		acct_keys = mmap(NULL, acct_cap * (sizeof(unsigned long) + sizeof(size_t)), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (acct_keys == MAP_FAILED) {
+			acct_keys = NULL;
+			acct_on = 0; /* no accounting rather than no allocator */
+			return;
+		}
+		acct_sizes = (size_t *)(acct_keys + acct_cap);
+	}
+	memset(acct_keys, 0, acct_cap * sizeof(unsigned long));
+	acct_used = 0;
+}
+
+/* records the requested size of block bp, doubling the table when it gets half full */
+static void acct_set(void *bp, size_t size)
+{
+	size_t i;
+
+	if (!acct_on)
+		return;
+	if (2 * (acct_used + 1) > acct_cap) {
+		unsigned long *old_keys = acct_keys;
+		size_t *old_sizes = acct_sizes;
+		size_t old_cap = acct_cap;
+		void *map = mmap(NULL, 2 * old_cap * (sizeof(unsigned long) + sizeof(size_t)), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED)
+			return; /* this block goes unaccounted */
+		acct_keys = map; /* fresh anonymous pages are already zero */
+		acct_cap = 2 * old_cap;
+		acct_sizes = (size_t *)(acct_keys + acct_cap);
+		for (i = 0; i < old_cap; i++) {
+			if (old_keys[i] != 0) {
+				size_t j = acct_slot((void *)old_keys[i]);
+				acct_keys[j] = old_keys[i];
+				acct_sizes[j] = old_sizes[i];
+			}
+		}
+		munmap(old_keys, old_cap * (sizeof(unsigned long) + sizeof(size_t)));
+	}
+	i = acct_slot(bp);
+	if (acct_keys[i] == 0)
+		acct_used++;
+	acct_keys[i] = (unsigned long)bp;
+	acct_sizes[i] = size;
+}
+
+/* forgets block bp, moving later blocks of its probe run back so that lookups still find them */
+static void acct_del(void *bp)
+{
+	size_t i, j, k;
+
+	if (!acct_on || bp == NULL || acct_keys[i = acct_slot(bp)] == 0)
+		return;
+	acct_used--;
+	for (j = (i + 1) & (acct_cap - 1); acct_keys[j] != 0; j = (j + 1) & (acct_cap - 1)) {
+		k = (((unsigned long)acct_keys[j] >> 3) * 2654435761UL) & (acct_cap - 1); /* home slot of the block at j */
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			acct_keys[i] = acct_keys[j];
+			acct_sizes[i] = acct_sizes[j];
+			i = j;
+		}
+	}
+	acct_keys[i] = 0;
+}
+
 /* 
  *
  *
@@ -212,9 +304,21 @@ int mm_init(void)
 	/* extend the empty heap with a free block of CHUNKSIZE bytes */
 	if (extend_heap(CHUNKSIZE/WSIZE) == NULL) {return -1;}
 	firstbp = heap_listp - WSIZE; /* changes global variable pointing to first block after prologue*/
+	mm_pagemap_reset(); /* pools and arenas from the previous heap are gone */
+	if (acct_on)
+		acct_reset(); /* and so are the accounted blocks */
     return 0;
 }
 
+/*
+ * mm_account - turn the side table of requested sizes, which mm_heap_stats uses to break down the allocated bytes, on or off.
+ * Takes effect at the next mm_init.
+ */
+void mm_account(int on)
+{
+	acct_on = on;
+}
+
 /* 
  * mm_malloc - attemps to find a free block and then returns that pointer
  *
@@ -245,6 +349,7 @@ void *mm_malloc(size_t size)
 	/* search the free list for a fit */
 	if ((bp = find_fit(asize)) != NULL) {
 		place(bp, asize);
+		acct_set(bp, size);
 		return bp;
 	}
 
@@ -253,6 +358,7 @@ void *mm_malloc(size_t size)
 	if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
 		return NULL;
 	place(bp, asize);
+	acct_set(bp, size);
 	return bp;
 }
 
@@ -261,16 +367,37 @@ void *mm_malloc(size_t size)
  */
 void mm_free(void *bp)
 {
+	/* pages owned by a pool or arena have no boundary tags, the owner frees them */
+	pm_owner_t *owner = mm_pagemap_get(bp);
+	if (owner != NULL) {
+		owner->free(owner, bp);
+		return;
+	}
+
 	size_t size = GET_SIZE(HDRP(bp));
 	PUT(HDRP(bp), PACK(size, 0));
 	PUT(FTRP(bp), PACK(size, 0));
+	acct_del(bp);
 	coalesce(bp);
 }
 
 /*
- * mm_realloc - L: work in progress, doesn't preserve data for some reason
+ * mm_realloc - resize the block, then move its entry in the side table, which realloc_block does not keep up to date when it resizes in place
  */
 void *mm_realloc(void *ptr, size_t size)
+{
+	void *newp = realloc_block(ptr, size);
+	if (acct_on && newp != NULL) {
+		acct_del(ptr);
+		acct_set(newp, size);
+	}
+	return newp;
+}
+
+/*
+ * realloc_block - L: work in progress, doesn't preserve data for some reason
+ */
+static void *realloc_block(void *ptr, size_t size)
 {
 	/* check if not allocated */
 	if(ptr == NULL)
@@ -283,6 +410,16 @@ void *mm_realloc(void *ptr, size_t size)
 		mm_free(ptr);
 		return NULL;
 	}
+	/* blocks owned by a pool or arena can only move: copy what fits and let the owner free the old one */
+	else if (mm_pagemap_get(ptr) != NULL)
+	{
+		size_t old_size = mm_usable_size(ptr);
+		void *new_ptr = mm_malloc(size);
+		if (new_ptr == NULL) {return NULL;}
+		memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+		mm_free(ptr);
+		return new_ptr;
+	}
 	/* compare sizes */
 	else
 	{
@@ -373,6 +510,169 @@ void *mm_realloc(void *ptr, size_t size)
 	}
 }
 
+/*
+ * mm_usable_size - number of payload bytes the block at bp can hold, asking the owner for pool and arena blocks
+ */
+size_t mm_usable_size(void *bp)
+{
+	pm_owner_t *owner;
+	
+	if (bp == NULL)
+		return 0;
+	if ((owner = mm_pagemap_get(bp)) != NULL)
+		return owner->usable_size(owner, bp);
+	return GET_SIZE(HDRP(bp)) - DSIZE;
+}
+
+/*
+ * mm_memalign - allocate a block whose payload address is a multiple of align (a power of 2).
+ * Over-allocates with mm_malloc, then gives the unaligned front and the unused tail back to the heap.
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+	char *bp, *abp, *mbp;
+	size_t csize, asize, gap;
+
+	if (align <= DSIZE) /* every payload is already DSIZE aligned */
+	{
+		return mm_malloc(size);
+	}
+	if (size == 0)
+		return NULL;
+	
+	/* room for the payload at any alignment plus a minimum size free block in front of it */
+	if ((bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+		return NULL;
+	mbp = bp;
+	csize = GET_SIZE(HDRP(bp));
+	
+	/* first aligned address that leaves either no gap or a gap big enough to be a free block */
+	abp = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+	if (abp != bp && (abp - bp) < 2*DSIZE)
+	{
+		abp += align;
+	}
+	gap = abp - bp;
+	
+	/* give the front back to the heap; it can only coalesce with the previous block */
+	if (gap > 0) {
+		PUT(HDRP(bp), PACK(gap, 0));
+		PUT(FTRP(bp), PACK(gap, 0));
+		PUT(HDRP(abp), PACK(csize - gap, 1));
+		PUT(FTRP(abp), PACK(csize - gap, 1));
+		coalesce(bp);
+	}
+	
+	/* same adjustment as mm_malloc, then split off the tail if it is big enough */
+	asize = (size <= DSIZE) ? 2*DSIZE : DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+	csize = GET_SIZE(HDRP(abp));
+	if ((csize - asize) >= (2*DSIZE)) {
+		PUT(HDRP(abp), PACK(asize, 1));
+		PUT(FTRP(abp), PACK(asize, 1));
+		bp = NEXT_BLKP(abp);
+		PUT(HDRP(bp), PACK(csize-asize, 0));
+		PUT(FTRP(bp), PACK(csize-asize, 0));
+		coalesce(bp);
+	}
+	if (acct_on) { /* mm_malloc recorded the over-allocated block */
+		acct_del(mbp);
+		acct_set(abp, size);
+	}
+	return abp;
+}
+
+/*
+ * mm_heap_stats - walk the boundary tags from the prologue to the epilogue and total up the allocated and free blocks.
+ * Pool and arena pages live inside allocated blocks, so they count as allocated.
+ * While mm_account is on, the allocated bytes of each block are split into the request, the tags, the padding and the slack.
+ */
+void mm_heap_stats(mm_heap_stats_t *st)
+{
+	char *bp;
+	size_t size, req, i;
+
+	memset(st, 0, sizeof(*st));
+	st->heap_bytes = mem_heapsize();
+	for (bp = NEXT_BLKP(firstbp); (size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp)) { /* past the prologue */
+		if (GET_ALLOC(HDRP(bp))) {
+			st->alloc_bytes += size;
+			st->alloc_blocks++;
+			if (acct_on && acct_keys[i = acct_slot(bp)] != 0) {
+				req = acct_sizes[i];
+				st->requested_bytes += req;
+				st->tag_bytes += DSIZE;
+				st->pad_bytes += ASIZE(req) - DSIZE - req;
+				st->slack_bytes += size - ASIZE(req);
+			}
+		}
+		else {
+			st->free_bytes += size;
+			st->free_blocks++;
+			if (size > st->largest_free)
+				st->largest_free = size;
+		}
+	}
+}
+
+/* used by mm_dump_heap to store n little-endian bytes of val at p */
+static void put_le(unsigned char *p, unsigned long long val, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		p[i] = (unsigned char)(val >> (8*i));
+}
+
+/* used by mm_dump_heap to write all of buf to fd, returns -1 on error */
+static int write_all(int fd, unsigned char *buf, size_t len)
+{
+	ssize_t n;
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * mm_dump_heap - write a snapshot of the heap in the MM_SNAP format of mm.h to fd.
+ * Walks the boundary tags with a buffer on the stack and never allocates, so it is safe to call on a heap in trouble.
+ * This is an implicit list allocator, so every free block is on the (one) free list. Returns 0 on success, -1 on a write error.
+ */
+int mm_dump_heap(int fd)
+{
+	unsigned char buf[4096];
+	size_t len = MM_SNAP_HDRSIZE;
+	size_t size;
+	unsigned int flags;
+	char *bp = NEXT_BLKP(firstbp); /* past the prologue */
+
+	memcpy(buf, MM_SNAP_MAGIC, 8);
+	put_le(buf + 8, MM_SNAP_VERSION, 4);
+	put_le(buf + 12, 0, 4);
+	put_le(buf + 16, (unsigned long)mem_heap_lo(), 8);
+	put_le(buf + 24, (unsigned long)bp, 8);
+	put_le(buf + 32, mem_heapsize(), 8);
+	for (;; bp = NEXT_BLKP(bp)) {
+		size = GET_SIZE(HDRP(bp));
+		if (GET_ALLOC(HDRP(bp)))
+			flags = MM_SNAP_ALLOC | ((size > 0 && mm_pagemap_get(bp) != NULL) ? MM_SNAP_OWNED : 0);
+		else
+			flags = MM_SNAP_FREE;
+		if (len + 4 > sizeof(buf)) {
+			if (write_all(fd, buf, len) < 0)
+				return -1;
+			len = 0;
+		}
+		put_le(buf + len, (size > 0) ? (size | flags) : 0, 4); /* the epilogue ends the snapshot */
+		len += 4;
+		if (size == 0)
+			break;
+	}
+	return write_all(fd, buf, len);
+}
+
 /*
 * This heap checker has extra checking mechanisms for our later experimented with segregated free list, but it didn't work, so we didn't submit
 * that solution but we still have the heap checker.
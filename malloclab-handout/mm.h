@@ -4,6 +4,46 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/* The shape of the heap, as found by walking its blocks */
+typedef struct {
+    size_t heap_bytes;   /* size of the heap */
+    size_t alloc_bytes;  /* bytes in allocated blocks, tags included */
+    size_t free_bytes;   /* bytes in free blocks */
+    size_t largest_free; /* size of the largest free block */
+    int alloc_blocks;    /* number of allocated blocks */
+    int free_blocks;     /* number of free blocks */
+
+    /* Where the allocated bytes went; only counted while mm_account is on */
+    size_t requested_bytes; /* sizes requested for the blocks */
+    size_t tag_bytes;       /* their headers and footers */
+    size_t pad_bytes;       /* rounding the requests up to the alignment */
+    size_t slack_bytes;     /* remainders too small to split off a block */
+} mm_heap_stats_t;
+
+extern void mm_heap_stats(mm_heap_stats_t *st);
+extern void mm_account(int on);
+
+/*
+ * Heap snapshots written by mm_dump_heap start with an MM_SNAP_HDRSIZE
+ * byte header: the 8 byte magic string, then little-endian 32 bit
+ * version and reserved words, and 64 bit addresses of the first heap
+ * byte and the first block, and the heap size. One little-endian 32
+ * bit word per block follows, in address order: the block size, which
+ * is a multiple of 8, or'd with MM_SNAP_xxx flags. Blocks are
+ * contiguous, so each one starts where the previous one ends. A zero
+ * word ends the snapshot.
+ */
+#define MM_SNAP_MAGIC   "MMHEAP01"
+#define MM_SNAP_VERSION 1
+#define MM_SNAP_HDRSIZE 40
+#define MM_SNAP_ALLOC   0x1  /* the block is allocated */
+#define MM_SNAP_FREE    0x2  /* the block is on a free list */
+#define MM_SNAP_OWNED   0x4  /* the block holds pool or arena pages */
+
+extern int mm_dump_heap(int fd);
 
 
 /* 
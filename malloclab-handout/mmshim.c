@@ -0,0 +1,282 @@
+/*
+ * mmshim.c - libmm.so, an LD_PRELOAD library that makes the mm package
+ *     the malloc of a real program.
+ *
+ *     usage: LD_PRELOAD=./libmm.so prog ...
+ *
+ * The malloc family of the C library is implemented on mm_malloc,
+ * mm_free, mm_realloc, mm_memalign and mm_usable_size, in a memlib
+ * heap of SHIM_HEAP bytes of address space that is committed as it
+ * grows. The mm package is not thread-safe, so every call holds
+ * shim_lock, as in mdriver -j. The lock is taken across fork so the
+ * child starts with a consistent heap.
+ *
+ * The heap is created by the first request rather than by a
+ * constructor, since other libraries allocate before constructors run.
+ * Creating it only maps memory, so it cannot reenter malloc. Blocks
+ * are returned SHIM_ALIGN aligned, which mm_malloc alone only
+ * guarantees when SHIM_ALIGN is 8.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/* Is p aligned to SHIM_ALIGN? */
+#define ALIGNED(p) (((unsigned long)(p) & (SHIM_ALIGN - 1)) == 0)
+
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static mem_heap_t *shim_heap = NULL;   /* set once the heap is usable */
+static char *heap_lo, *heap_hi;        /* the heap's reserved range */
+
+/*
+ * shim_init - create the heap and initialize mm on it. Called with
+ *     shim_lock held. Returns 0 on success and -1 on error.
+ */
+static int shim_init(void)
+{
+    mem_heap_t *heap;
+
+    if ((heap = mem_heap_create(SHIM_HEAP)) == NULL)
+	return -1;
+    mem_heap_select(heap);
+    if (mm_init() < 0) {
+	mem_heap_destroy(heap);
+	return -1;
+    }
+    heap_lo = mem_heap_lo_of(heap);
+    heap_hi = heap_lo + SHIM_HEAP;
+    shim_heap = heap;
+    return 0;
+}
+
+/*
+ * shim_enter - take shim_lock, creating the heap on first use.
+ *     Returns 0 on success, or -1 without the lock if there is no heap.
+ */
+static int shim_enter(void)
+{
+    pthread_mutex_lock(&shim_lock);
+    if (shim_heap == NULL && shim_init() < 0) {
+	pthread_mutex_unlock(&shim_lock);
+	return -1;
+    }
+    return 0;
+}
+
+static void shim_leave(void)
+{
+    pthread_mutex_unlock(&shim_lock);
+}
+
+/*
+ * ours - did p come from the shim's heap? Blocks from elsewhere (the
+ *     dynamic loader's early allocations) are never freed.
+ */
+static int ours(void *p)
+{
+    return shim_heap != NULL && (char *)p >= heap_lo && (char *)p < heap_hi;
+}
+
+/*
+ * shim_alloc - allocate a SHIM_ALIGN aligned block of size bytes, or
+ *     an align aligned one if align is larger. Called with shim_lock.
+ */
+static void *shim_alloc(size_t align, size_t size)
+{
+    if (size == 0)
+	size = 1;   /* malloc(0) must return a unique pointer */
+    if (size >= SHIM_MAX_REQUEST)
+	return NULL;
+    if (align < SHIM_ALIGN)
+	align = SHIM_ALIGN;
+    if (align > ALIGNMENT)
+	return mm_memalign(align, size);
+    return mm_malloc(size);
+}
+
+void *malloc(size_t size)
+{
+    void *p = NULL;
+
+    if (shim_enter() == 0) {
+	p = shim_alloc(SHIM_ALIGN, size);
+	shim_leave();
+    }
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || !ours(ptr))
+	return;
+    pthread_mutex_lock(&shim_lock);
+    mm_free(ptr);
+    pthread_mutex_unlock(&shim_lock);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p = NULL;
+
+    if (size != 0 && nmemb > (size_t)-1 / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    /* not malloc, which the compiler would fuse with the memset into calloc */
+    if (shim_enter() == 0) {
+	p = shim_alloc(SHIM_ALIGN, nmemb * size);
+	shim_leave();
+    }
+    if (p == NULL)
+	errno = ENOMEM;
+    else
+	memset(p, 0, nmemb * size);
+    return p;
+}
+
+/*
+ * realloc - a block that mm_realloc moves to a less aligned address is
+ *     moved again to an aligned one, if there is room; otherwise the
+ *     less aligned block is returned rather than failing, since the
+ *     original is gone by then.
+ */
+void *realloc(void *ptr, size_t size)
+{
+    void *p = NULL, *q;
+    size_t old;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (size >= SHIM_MAX_REQUEST || shim_enter() < 0) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (!ours(ptr)) {
+	/* 
+	 * A loader block, whose size is unknown: copy size bytes, which
+	 * may read past its end, into a block of ours, and leave the
+	 * loader block alone as free does
+	 */
+	if ((p = shim_alloc(SHIM_ALIGN, size)) != NULL)
+	    memcpy(p, ptr, size);
+    }
+    else if (ALIGNED(ptr) && (p = mm_realloc(ptr, size)) != NULL) {
+	if (!ALIGNED(p) && (q = shim_alloc(SHIM_ALIGN, size)) != NULL) {
+	    memcpy(q, p, size);
+	    mm_free(p);
+	    p = q;
+	}
+    }
+    else {
+	old = mm_usable_size(ptr);
+	if ((p = shim_alloc(SHIM_ALIGN, size)) != NULL) {
+	    memcpy(p, ptr, (old < size) ? old : size);
+	    mm_free(ptr);
+	}
+    }
+    shim_leave();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p = NULL;
+
+    if (align == 0 || (align & (align - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if (shim_enter() == 0) {
+	p = shim_alloc(align, size);
+	shim_leave();
+    }
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)) != 0)
+	return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    return memalign(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    size_t n;
+
+    if (ptr == NULL || !ours(ptr))
+	return 0;
+    pthread_mutex_lock(&shim_lock);
+    n = mm_usable_size(ptr);
+    pthread_mutex_unlock(&shim_lock);
+    return n;
+}
+
+/*
+ * The fork handlers hold shim_lock across fork, so that the child's
+ * copy of the heap is not in the middle of a request. The child has
+ * only the forking thread, so it can simply reset the lock.
+ */
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&shim_lock);
+}
+
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&shim_lock);
+}
+
+static void fork_child(void)
+{
+    pthread_mutex_init(&shim_lock, NULL);
+}
+
+/*
+ * shim_start - library constructor: register the fork handlers.
+ *     pthread_atfork may itself call malloc, which is why this happens
+ *     outside shim_lock.
+ */
+__attribute__((constructor))
+static void shim_start(void)
+{
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
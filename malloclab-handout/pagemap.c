@@ -0,0 +1,195 @@
+/*
+ * pagemap.c - radix tree page map.
+ *
+ * The key is the page number of an address, split into three levels of
+ * PM_BITS_1/2/3 bits. The root is a static array; interior nodes and
+ * leaves are mmap'd on first use and never freed, so a lookup is three
+ * dependent loads with no locking. Nodes are zero-filled by the kernel
+ * and published with a release store (and a compare-and-swap, so that
+ * two threads registering pages under the same empty slot cannot lose
+ * an update), so a concurrent reader sees either NULL or a fully
+ * initialized node. The bounds of the registered pages, which reset
+ * scans, are widened with compare-and-swap loops for the same reason.
+ *
+ * The tree covers the whole user address space, so it works for every
+ * heap memlib can create, not just the default one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "pagemap.h"
+
+/* Number of significant bits in a user space address */
+#if UINTPTR_MAX > 0xffffffffUL
+#define PM_ADDR_BITS 48
+#else
+#define PM_ADDR_BITS 32
+#endif
+
+/* Split of the page number among the three levels of the tree */
+#define PM_KEY_BITS (PM_ADDR_BITS - PM_PAGE_SHIFT)
+#define PM_BITS_3 (PM_KEY_BITS / 3)
+#define PM_BITS_2 (PM_KEY_BITS / 3)
+#define PM_BITS_1 (PM_KEY_BITS - PM_BITS_2 - PM_BITS_3)
+
+#define PM_LEN(bits) (1UL << (bits))
+#define PM_IDX1(key) ((key) >> (PM_BITS_2 + PM_BITS_3))
+#define PM_IDX2(key) (((key) >> PM_BITS_3) & (PM_LEN(PM_BITS_2) - 1))
+#define PM_IDX3(key) ((key) & (PM_LEN(PM_BITS_3) - 1))
+
+typedef struct {
+    pm_owner_t *owner[PM_LEN(PM_BITS_3)];
+} pm_leaf_t;
+
+typedef struct {
+    pm_leaf_t *leaf[PM_LEN(PM_BITS_2)];
+} pm_node_t;
+
+/* private variables */
+static pm_node_t *pm_root[PM_LEN(PM_BITS_1)];
+static uintptr_t pm_lo_key = UINTPTR_MAX; /* lowest page ever registered */
+static uintptr_t pm_hi_key = 0;           /* highest page ever registered */
+
+/*
+ * pm_alloc - get zero-filled memory for a tree node without calling
+ *     any malloc package
+ */
+static void *pm_alloc(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED) {
+	fprintf(stderr, "mm_pagemap: mmap error\n");
+	exit(1);
+    }
+    return p;
+}
+
+/*
+ * pm_install - publish a new node in *slot unless another thread beat
+ *     us to it, and return the node that ended up there
+ */
+static void *pm_install(void **slot, size_t size)
+{
+    void *node = pm_alloc(size);
+    void *expected = NULL;
+
+    if (!__atomic_compare_exchange_n(slot, &expected, node, 0,
+				     __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+	munmap(node, size);
+	return expected;
+    }
+    return node;
+}
+
+/*
+ * pm_leaf - return the leaf that holds key, creating it if create is set
+ */
+static pm_leaf_t *pm_leaf(uintptr_t key, int create)
+{
+    pm_node_t *node = __atomic_load_n(&pm_root[PM_IDX1(key)], __ATOMIC_ACQUIRE);
+    pm_leaf_t *leaf;
+
+    if (node == NULL) {
+	if (!create)
+	    return NULL;
+	node = pm_install((void **)&pm_root[PM_IDX1(key)], sizeof(pm_node_t));
+    }
+    leaf = __atomic_load_n(&node->leaf[PM_IDX2(key)], __ATOMIC_ACQUIRE);
+    if (leaf == NULL && create)
+	leaf = pm_install((void **)&node->leaf[PM_IDX2(key)], sizeof(pm_leaf_t));
+    return leaf;
+}
+
+/*
+ * pm_lower - lower *bound to key, unless another thread lowered it
+ *     further
+ */
+static void pm_lower(uintptr_t *bound, uintptr_t key)
+{
+    uintptr_t old = __atomic_load_n(bound, __ATOMIC_RELAXED);
+
+    while (key < old &&
+	   !__atomic_compare_exchange_n(bound, &old, key, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+}
+
+/*
+ * pm_raise - raise *bound to key, unless another thread raised it
+ *     further
+ */
+static void pm_raise(uintptr_t *bound, uintptr_t key)
+{
+    uintptr_t old = __atomic_load_n(bound, __ATOMIC_RELAXED);
+
+    while (key > old &&
+	   !__atomic_compare_exchange_n(bound, &old, key, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+}
+
+/*
+ * mm_pagemap_set - record owner (or NULL to clear) for every page in
+ *     [addr, addr+len). Both must be multiples of PM_PAGESIZE.
+ */
+void mm_pagemap_set(void *addr, size_t len, pm_owner_t *owner)
+{
+    uintptr_t key = (uintptr_t)addr >> PM_PAGE_SHIFT;
+    uintptr_t end = ((uintptr_t)addr + len) >> PM_PAGE_SHIFT;
+    pm_leaf_t *leaf;
+
+    if (key >= end)
+	return;
+    if (owner != NULL) {
+	pm_lower(&pm_lo_key, key);
+	pm_raise(&pm_hi_key, end - 1);
+    }
+    for (; key < end; key++) {
+	if ((leaf = pm_leaf(key, owner != NULL)) != NULL)
+	    __atomic_store_n(&leaf->owner[PM_IDX3(key)], owner, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * mm_pagemap_get - return the owner of the page holding p, or NULL if
+ *     the page belongs to the boundary-tagged heap (or to nobody)
+ */
+pm_owner_t *mm_pagemap_get(void *p)
+{
+    uintptr_t key = (uintptr_t)p >> PM_PAGE_SHIFT;
+    pm_node_t *node;
+    pm_leaf_t *leaf;
+
+    if (PM_IDX1(key) >= PM_LEN(PM_BITS_1))
+	return NULL;
+    if ((node = __atomic_load_n(&pm_root[PM_IDX1(key)], __ATOMIC_ACQUIRE)) == NULL)
+	return NULL;
+    if ((leaf = __atomic_load_n(&node->leaf[PM_IDX2(key)], __ATOMIC_ACQUIRE)) == NULL)
+	return NULL;
+    return __atomic_load_n(&leaf->owner[PM_IDX3(key)], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * mm_pagemap_reset - forget every registration. mm_init calls this
+ *     because the driver recycles the heap without destroying the
+ *     pools and arenas that registered pages in it. Unlike set and
+ *     get, it must not run concurrently with other calls.
+ */
+void mm_pagemap_reset(void)
+{
+    uintptr_t key;
+    pm_leaf_t *leaf;
+
+    for (key = pm_lo_key; key <= pm_hi_key; key += PM_LEN(PM_BITS_3)) {
+	if ((leaf = pm_leaf(key, 0)) != NULL)
+	    memset(leaf, 0, sizeof(pm_leaf_t));
+	key &= ~(PM_LEN(PM_BITS_3) - 1);
+    }
+    pm_lo_key = UINTPTR_MAX;
+    pm_hi_key = 0;
+}
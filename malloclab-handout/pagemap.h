@@ -0,0 +1,25 @@
+/*
+ * pagemap.h - radix tree that maps page numbers to the subsystem that
+ *     owns the page, so that mm_free can route pointers that are not
+ *     ordinary boundary-tagged blocks without reading their header.
+ */
+#include <stddef.h>
+
+/* The page map works in 4 KB pages, whatever the system page size */
+#define PM_PAGE_SHIFT 12
+#define PM_PAGESIZE (1UL << PM_PAGE_SHIFT)
+
+/*
+ * Every subsystem that registers pages embeds one of these as the
+ * first member of its own record. free releases a pointer into the
+ * owner's pages and usable_size reports how many bytes at that pointer
+ * the caller may use.
+ */
+typedef struct pm_owner {
+    void (*free)(struct pm_owner *owner, void *p);
+    size_t (*usable_size)(struct pm_owner *owner, void *p);
+} pm_owner_t;
+
+void mm_pagemap_set(void *addr, size_t len, pm_owner_t *owner);
+pm_owner_t *mm_pagemap_get(void *p);
+void mm_pagemap_reset(void);
@@ -0,0 +1,141 @@
+/*
+ * perfctr.c - hardware performance counters via perf_event_open.
+ *
+ * Each event is opened on its own rather than as a group, so one that
+ * the CPU lacks does not take the others down with it. Counting is
+ * limited to user mode in the calling thread, which unprivileged users
+ * may do at the default perf_event_paranoid setting. If the kernel
+ * multiplexes the counters, the counts are scaled up by the fraction
+ * of the time each one was actually running.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* Generic hardware cache event selectors */
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static struct {
+    unsigned type;
+    unsigned long long config;
+} events[PC_NUM] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, 
+				     PERF_COUNT_HW_CACHE_OP_READ,
+				     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, 
+				     PERF_COUNT_HW_CACHE_OP_READ,
+				     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+#endif
+
+static const char *names[PC_NUM] = {
+    "cycles", "instrs", "L1D-miss", "LLC-miss", "dTLB-miss", "br-miss"
+};
+
+/*
+ * perfctr_open - open every counter that is available. Returns the
+ *     number of counters opened, which is 0 if the kernel does not
+ *     permit counting at all.
+ */
+int perfctr_open(perfctr_t *pc)
+{
+    int i, n = 0;
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    for (i = 0; i < PC_NUM; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	pc->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (pc->fd[i] >= 0)
+	    n++;
+	pc->value[i] = 0;
+    }
+#else
+    for (i = 0; i < PC_NUM; i++) {
+	pc->fd[i] = -1;
+	pc->value[i] = 0;
+    }
+#endif
+    return n;
+}
+
+/*
+ * perfctr_start - zero the open counters and start them
+ */
+void perfctr_start(perfctr_t *pc)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < PC_NUM; i++)
+	if (pc->fd[i] >= 0) {
+	    ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+/*
+ * perfctr_stop - stop the open counters and read them into pc->value
+ */
+void perfctr_stop(perfctr_t *pc)
+{
+#ifdef __linux__
+    unsigned long long buf[3];  /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PC_NUM; i++)
+	if (pc->fd[i] >= 0)
+	    ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PC_NUM; i++) {
+	pc->value[i] = 0;
+	if (pc->fd[i] < 0 || read(pc->fd[i], buf, sizeof(buf)) != sizeof(buf))
+	    continue;
+	if (buf[2] > 0 && buf[2] < buf[1])
+	    buf[0] = (unsigned long long)((double)buf[0] * buf[1] / buf[2]);
+	pc->value[i] = buf[0];
+    }
+#endif
+}
+
+/*
+ * perfctr_close - close the open counters
+ */
+void perfctr_close(perfctr_t *pc)
+{
+    int i;
+
+    for (i = 0; i < PC_NUM; i++)
+	if (pc->fd[i] >= 0) {
+	    close(pc->fd[i]);
+	    pc->fd[i] = -1;
+	}
+}
+
+/*
+ * perfctr_name - short column name of counter i
+ */
+const char *perfctr_name(int i)
+{
+    return names[i];
+}
@@ -0,0 +1,26 @@
+/*
+ * perfctr.h - hardware performance counters for a stretch of code, read
+ *     with Linux perf_event_open. Counters that the CPU or the kernel
+ *     does not provide are simply marked unavailable.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The events counted */
+enum {
+    PC_CYCLES, PC_INSTRUCTIONS, PC_L1D_MISSES, PC_LLC_MISSES,
+    PC_DTLB_MISSES, PC_BRANCH_MISSES, PC_NUM
+};
+
+typedef struct {
+    int fd[PC_NUM];                  /* counter fds, -1 if unavailable */
+    unsigned long long value[PC_NUM]; /* counts from the last perfctr_stop */
+} perfctr_t;
+
+int perfctr_open(perfctr_t *pc);
+void perfctr_start(perfctr_t *pc);
+void perfctr_stop(perfctr_t *pc);
+void perfctr_close(perfctr_t *pc);
+const char *perfctr_name(int i);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,229 @@
+/*
+ * pool.c - typed fixed-size object pools built on the mm package.
+ *
+ * A pool hands out objects from runs: blocks of run_size bytes obtained
+ * from mm_memalign, aligned to run_size so that the run holding an
+ * object is found by masking the object's address. Each run starts with
+ * a header padded to a cache line, or to the object alignment if that
+ * is larger, followed by the objects. Freed objects are
+ * kept on an intrusive freelist inside the run, and objects that were
+ * never handed out are carved off lazily so a new run is not touched
+ * all at once.
+ *
+ * Objects are laid out so that they do not straddle cache lines: the
+ * stride of objects smaller than a cache line is rounded up to a power
+ * of 2, and larger objects start on a cache line boundary.
+ *
+ * Runs with free objects are kept on the pool's partial list. A run
+ * whose last object is freed goes back to the heap, unless it is the
+ * only partial run left, in which case it is kept to avoid thrashing.
+ *
+ * Runs are registered in the page map, so plain mm_free (and
+ * mm_realloc and mm_usable_size) also work on pool objects.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "mm.h"
+#include "pagemap.h"
+#include "config.h"
+
+/* Rounds x up to a multiple of a (a must be a power of 2) */
+#define ROUNDUP(x, a) (((x) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+/* Minimum number of objects in a run */
+#define RUN_MINOBJS 8
+
+/* Header at the start of every run, padded to the pool's data offset */
+typedef struct pool_run {
+    struct pool_run *next;  /* next run in the pool's partial list */
+    struct pool_run *prev;  /* previous run in the pool's partial list */
+    void *free;             /* freelist of released objects */
+    char *bump;             /* first object that was never handed out */
+    int used;               /* objects currently allocated from the run */
+    int partial;            /* is the run on the partial list? */
+} pool_run_t;
+
+struct mm_pool {
+    pm_owner_t owner;       /* page map owner of the pool's runs */
+    size_t stride;          /* distance between consecutive objects */
+    size_t data;            /* offset of the first object in a run */
+    size_t run_size;        /* size and alignment of every run */
+    size_t run_end;         /* offset of the end of the last object */
+    pool_run_t *partial;    /* runs that have free objects */
+};
+
+/*
+ * pool_owner_free - page map callback for mm_free of a pool object
+ */
+static void pool_owner_free(pm_owner_t *owner, void *p)
+{
+    mm_pool_free((mm_pool_t *)owner, p);
+}
+
+/*
+ * pool_owner_usable_size - page map callback for mm_usable_size
+ */
+static size_t pool_owner_usable_size(pm_owner_t *owner, void *p)
+{
+    return ((mm_pool_t *)owner)->stride;
+}
+
+/*
+ * mm_pool_create - create a pool of objects of obj_size bytes, each
+ *     aligned to align bytes (a power of 2, or 0 for ALIGNMENT)
+ */
+mm_pool_t *mm_pool_create(size_t obj_size, size_t align)
+{
+    mm_pool_t *pool;
+    size_t stride, nobjs;
+
+    if (align < ALIGNMENT)
+	align = ALIGNMENT;
+    if (obj_size < sizeof(void *))
+	obj_size = sizeof(void *);
+    stride = ROUNDUP(obj_size, align);
+
+    /* cache line aware layout */
+    if (stride < POOL_CACHELINE) {
+	size_t pow2 = ALIGNMENT;
+	while (pow2 < stride)
+	    pow2 <<= 1;
+	stride = pow2;
+    }
+    else
+	stride = ROUNDUP(stride, POOL_CACHELINE);
+
+    if ((pool = mm_malloc(sizeof(mm_pool_t))) == NULL)
+	return NULL;
+    pool->owner.free = pool_owner_free;
+    pool->owner.usable_size = pool_owner_usable_size;
+    pool->stride = stride;
+    pool->data = ROUNDUP(sizeof(pool_run_t), 
+			 align > POOL_CACHELINE ? align : POOL_CACHELINE);
+    pool->run_size = POOL_RUNSIZE;
+    while (pool->run_size < pool->data + RUN_MINOBJS * stride)
+	pool->run_size <<= 1;
+    nobjs = (pool->run_size - pool->data) / stride;
+    pool->run_end = pool->data + nobjs * stride;
+    pool->partial = NULL;
+    return pool;
+}
+
+/*
+ * partial_add - put run at the head of the partial list of pool
+ */
+static void partial_add(mm_pool_t *pool, pool_run_t *run)
+{
+    run->prev = NULL;
+    run->next = pool->partial;
+    if (pool->partial != NULL)
+	pool->partial->prev = run;
+    pool->partial = run;
+    run->partial = 1;
+}
+
+/*
+ * partial_remove - take run off the partial list of pool
+ */
+static void partial_remove(mm_pool_t *pool, pool_run_t *run)
+{
+    if (run->prev != NULL)
+	run->prev->next = run->next;
+    else
+	pool->partial = run->next;
+    if (run->next != NULL)
+	run->next->prev = run->prev;
+    run->partial = 0;
+}
+
+/*
+ * release_run - unregister run and give it back to the heap
+ */
+static void release_run(mm_pool_t *pool, pool_run_t *run)
+{
+    mm_pagemap_set(run, pool->run_size, NULL);
+    mm_free(run);
+}
+
+/*
+ * new_run - get a fresh run from the heap and put it on the partial
+ *     list. Returns NULL if the heap is exhausted.
+ */
+static pool_run_t *new_run(mm_pool_t *pool)
+{
+    pool_run_t *run;
+
+    if ((run = mm_memalign(pool->run_size, pool->run_size)) == NULL)
+	return NULL;
+    run->free = NULL;
+    run->bump = (char *)run + pool->data;
+    run->used = 0;
+    partial_add(pool, run);
+    mm_pagemap_set(run, pool->run_size, &pool->owner);
+    return run;
+}
+
+/*
+ * mm_pool_alloc - allocate one object from pool
+ */
+void *mm_pool_alloc(mm_pool_t *pool)
+{
+    pool_run_t *run = pool->partial;
+    void *p;
+
+    if (run == NULL && (run = new_run(pool)) == NULL)
+	return NULL;
+
+    if (run->free != NULL) {
+	p = run->free;
+	run->free = *(void **)p;
+    }
+    else {
+	p = run->bump;
+	run->bump += pool->stride;
+    }
+    run->used++;
+
+    /* a run with nothing left to hand out leaves the partial list */
+    if (run->free == NULL && 
+	run->bump == (char *)run + pool->run_end)
+	partial_remove(pool, run);
+    return p;
+}
+
+/*
+ * mm_pool_free - return object p to pool
+ */
+void mm_pool_free(mm_pool_t *pool, void *p)
+{
+    pool_run_t *run = (pool_run_t *)((size_t)p & ~(pool->run_size - 1));
+
+    *(void **)p = run->free;
+    run->free = p;
+    run->used--;
+
+    if (!run->partial)
+	partial_add(pool, run);
+    else if (run->used == 0 && (run->next != NULL || run->prev != NULL)) {
+	/* empty, and not the last run with room: back to the heap */
+	partial_remove(pool, run);
+	release_run(pool, run);
+    }
+}
+
+/*
+ * mm_pool_destroy - release pool. Runs that still hold objects are
+ *     not tracked by the pool, so every object must have been freed.
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    pool_run_t *run, *next;
+
+    for (run = pool->partial; run != NULL; run = next) {
+	next = run->next;
+	release_run(pool, run);
+    }
+    mm_free(pool);
+}
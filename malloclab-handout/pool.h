@@ -0,0 +1,19 @@
+/*
+ * pool.h - typed fixed-size object pools built on the mm package.
+ *     Every object in a pool has the same size, so allocation and free
+ *     are a push or pop on an intrusive freelist.
+ */
+#include <stddef.h>
+
+/* Bytes in a cache line; small objects never straddle one */
+#define POOL_CACHELINE 64
+
+/* Default size (and alignment) in bytes of the runs that hold objects */
+#define POOL_RUNSIZE (16*(1<<10))
+
+typedef struct mm_pool mm_pool_t;
+
+mm_pool_t *mm_pool_create(size_t obj_size, size_t align);
+void *mm_pool_alloc(mm_pool_t *pool);
+void mm_pool_free(mm_pool_t *pool, void *p);
+void mm_pool_destroy(mm_pool_t *pool);
@@ -0,0 +1,546 @@
+/*
+ * record.c - an LD_PRELOAD library that records the heap requests of a
+ *     real program as a trace that mdriver can replay.
+ *
+ *     usage: MM_RECORD=prog.rep LD_PRELOAD=./librecord.so prog ...
+ *
+ * A trace file ending in ".bin" is written in the binary format of
+ * tracefmt.h, any other name as a .rep text trace.
+ *
+ * The wrappers of malloc, calloc, realloc, free, posix_memalign,
+ * memalign and aligned_alloc call the glibc implementations and append
+ * a raw record of the request to a buffer owned by the calling thread,
+ * so recording takes no locks. Full buffers are appended to a raw file
+ * with a single write. The records are ordered by a global sequence
+ * number, taken while the thread owns the block: after the allocation
+ * returns, and before a free. When the program exits, the raw records
+ * are sorted by sequence number and block addresses are turned into
+ * trace ids. Only then are num_ids and num_ops known, so the trace is
+ * written at that point.
+ *
+ * Only the process started with MM_RECORD records. The constructor
+ * removes it from the environment, so programs it execs leave the trace
+ * alone, and forked children stop recording. The raw file is named after
+ * the pid of the recording process.
+ *
+ * realloc records two events. The first releases the old block before
+ * the call, and the second acquires the new block after it, so another
+ * thread can reuse the old address in between. A realloc that fails
+ * gives the old block back its id instead, and is not in the trace.
+ * Aligned allocations are replayed as plain ones.
+ *
+ * Every record also holds the time the request was made, before the
+ * call into glibc, so the trace is timed (TF_FLAG_TIMED): each request
+ * carries the time since the one before it, for mdriver -O.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "tracefmt.h"
+
+/* The glibc allocator, which the wrappers forward to */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t align, size_t size);
+
+/* Records per thread buffer */
+#define REC_BUFOPS 4096
+
+/* Raw record types */
+#define R_ALLOC   0   /* ptr was allocated */
+#define R_FREE    1   /* ptr is about to be freed */
+#define R_RBEGIN  2   /* ptr is about to be realloc'd... */
+#define R_REND    3   /* ... and the realloc returned ptr */
+#define R_RFAIL   4   /* ... or failed, leaving ptr as it was */
+
+/* One raw record, as written to the raw file */
+typedef struct {
+    unsigned long long seq;  /* global order of the event */
+    unsigned long ptr;       /* block address */
+    unsigned long size;      /* requested size (R_ALLOC, R_REND) */
+    unsigned long long ns;   /* when the request was made */
+    unsigned tid;            /* recording thread */
+    unsigned type;           /* R_xxx */
+} rec_t;
+
+/* A thread's buffer of records; all buffers are chained for exit */
+typedef struct tbuf {
+    struct tbuf *next;
+    unsigned tid;
+    int n;
+    rec_t recs[REC_BUFOPS];
+} tbuf_t;
+
+static char trace_path[4096];         /* the trace to write */
+static char raw_path[4096];           /* raw records while recording */
+static int raw_fd = -1;
+static pid_t owner;                   /* process that records */
+static volatile int recording = 0;    /* are requests being recorded? */
+static unsigned long long next_seq = 0;
+static unsigned next_tid = 0;
+static tbuf_t *all_bufs = NULL;       /* every thread's buffer */
+static pthread_key_t buf_key;
+
+static __thread tbuf_t *my_buf = NULL;
+static __thread int busy = 0;         /* inside the recorder itself? */
+
+/*
+ * flush - append the records in b to the raw file and empty it
+ */
+static void flush(tbuf_t *b)
+{
+    char *p = (char *)b->recs;
+    size_t left = b->n * sizeof(rec_t);
+    ssize_t n;
+
+    while (left > 0) {
+	if ((n = write(raw_fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    recording = 0;  /* out of disk: give up quietly */
+	    break;
+	}
+	p += n;
+	left -= n;
+    }
+    b->n = 0;
+}
+
+/*
+ * thread_exit - pthread key destructor that flushes an exiting
+ *     thread's records. The buffer stays on all_bufs, empty.
+ */
+static void thread_exit(void *arg)
+{
+    if (recording)
+	flush((tbuf_t *)arg);
+}
+
+/*
+ * get_buf - the calling thread's buffer, created on first use
+ */
+static tbuf_t *get_buf(void)
+{
+    tbuf_t *b;
+
+    if (my_buf != NULL)
+	return my_buf;
+    if ((b = __libc_malloc(sizeof(tbuf_t))) == NULL)
+	return NULL;
+    b->n = 0;
+    b->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    b->next = __atomic_load_n(&all_bufs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&all_bufs, &b->next, b, 1,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	;
+    pthread_setspecific(buf_key, b);
+    return my_buf = b;
+}
+
+/*
+ * arrival - the time of a request in ns, if it is being recorded
+ */
+static unsigned long long arrival(void)
+{
+    struct timespec ts;
+
+    if (!recording)
+	return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * record - append one event, of a request made at time ns, to the
+ *     calling thread's buffer
+ */
+static void record(unsigned type, void *ptr, size_t size, 
+		   unsigned long long ns)
+{
+    tbuf_t *b;
+    rec_t *r;
+
+    if (!recording || busy)
+	return;
+    busy = 1;
+    if ((b = get_buf()) != NULL) {
+	r = &b->recs[b->n++];
+	r->seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+	r->ptr = (unsigned long)ptr;
+	r->size = size;
+	r->ns = ns;
+	r->tid = b->tid;
+	r->type = type;
+	if (b->n == REC_BUFOPS)
+	    flush(b);
+    }
+    busy = 0;
+}
+
+/*
+ * The interposed allocator entry points
+ */
+void *malloc(size_t size)
+{
+    unsigned long long t = arrival();
+    void *p = __libc_malloc(size);
+
+    if (p != NULL)
+	record(R_ALLOC, p, size, t);
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    unsigned long long t = arrival();
+    void *p = __libc_calloc(nmemb, size);
+
+    if (p != NULL)
+	record(R_ALLOC, p, nmemb * size, t);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+    unsigned long long t;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    t = arrival();
+    record(R_RBEGIN, ptr, 0, t);
+    p = __libc_realloc(ptr, size);
+    if (p != NULL)
+	record(R_REND, p, size, t);
+    else
+	record(R_RFAIL, ptr, 0, t);
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    record(R_FREE, ptr, 0, arrival());
+    __libc_free(ptr);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    unsigned long long t = arrival();
+    void *p = __libc_memalign(align, size);
+
+    if (p != NULL)
+	record(R_ALLOC, p, size, t);
+    return p;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)) != 0)
+	return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*
+ * atfork_child - a forked child is a different program as far as the
+ *     trace is concerned, so it stops recording into the parent's file
+ */
+static void atfork_child(void)
+{
+    recording = 0;
+}
+
+/*
+ * record_start - library constructor: start recording if MM_RECORD
+ *     names a trace file
+ */
+__attribute__((constructor))
+static void record_start(void)
+{
+    char *path = getenv("MM_RECORD");
+
+    if (path == NULL || strlen(path) + 16 > sizeof(trace_path))
+	return;
+    strcpy(trace_path, path);
+    /* programs this one execs must not record over the same trace */
+    unsetenv("MM_RECORD");
+    sprintf(raw_path, "%s.%d.raw", trace_path, (int)getpid());
+    if ((raw_fd = open(raw_path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND,
+		       0644)) < 0) {
+	perror(raw_path);
+	return;
+    }
+    pthread_key_create(&buf_key, thread_exit);
+    pthread_atfork(NULL, NULL, atfork_child);
+    owner = getpid();
+    recording = 1;
+}
+
+/******************************************************
+ * Converting the raw records to a trace at exit
+ *****************************************************/
+
+/* Open-addressing map from live block addresses to trace ids */
+typedef struct {
+    unsigned long *keys;    /* block addresses, 0 for an empty slot */
+    int *ids;
+    size_t cap;             /* a power of 2 */
+    size_t used;
+} idmap_t;
+
+/* Hashes a block address, whose low bits are mostly zero */
+#define HASH(p) (((p) >> 4) * 0x9E3779B97F4A7C15ULL)
+
+static size_t idmap_slot(idmap_t *m, unsigned long key)
+{
+    size_t i = HASH(key) & (m->cap - 1);
+
+    while (m->keys[i] != 0 && m->keys[i] != key)
+	i = (i + 1) & (m->cap - 1);
+    return i;
+}
+
+static void idmap_init(idmap_t *m)
+{
+    m->cap = 1024;
+    m->used = 0;
+    m->keys = calloc(m->cap, sizeof(unsigned long));
+    m->ids = malloc(m->cap * sizeof(int));
+}
+
+static void idmap_put(idmap_t *m, unsigned long key, int id)
+{
+    idmap_t old = *m;
+    size_t i;
+
+    if (2 * (m->used + 1) > m->cap) {
+	m->cap *= 2;
+	m->used = 0;
+	m->keys = calloc(m->cap, sizeof(unsigned long));
+	m->ids = malloc(m->cap * sizeof(int));
+	for (i = 0; i < old.cap; i++)
+	    if (old.keys[i] != 0)
+		idmap_put(m, old.keys[i], old.ids[i]);
+	free(old.keys);
+	free(old.ids);
+    }
+    i = idmap_slot(m, key);
+    if (m->keys[i] == 0)
+	m->used++;
+    m->keys[i] = key;
+    m->ids[i] = id;
+}
+
+/*
+ * idmap_take - remove key from m and return its id, or -1 if absent
+ */
+static int idmap_take(idmap_t *m, unsigned long key)
+{
+    size_t i = idmap_slot(m, key), j;
+    int id;
+    unsigned long k;
+
+    if (m->keys[i] == 0)
+	return -1;
+    id = m->ids[i];
+    m->keys[i] = 0;
+    m->used--;
+
+    /* Reinsert the rest of the cluster so lookups still find it */
+    for (j = (i + 1) & (m->cap - 1); m->keys[j] != 0;
+	 j = (j + 1) & (m->cap - 1)) {
+	k = m->keys[j];
+	m->keys[j] = 0;
+	m->used--;
+	idmap_put(m, k, m->ids[j]);
+    }
+    return id;
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+    unsigned long long x = ((const rec_t *)a)->seq;
+    unsigned long long y = ((const rec_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * emit - turn the sorted records into trace requests, counting them in
+ *     hdr. Writes them to out unless it is NULL; binary traces are
+ *     encoded into out after the header. The gap of each request is
+ *     the time since the previous one; since the threads' records are
+ *     ordered by sequence number rather than time, it may come out
+ *     negative, and is then 0.
+ */
+static void emit(rec_t *recs, size_t n, int binary, FILE *out,
+		 tf_header_t *hdr)
+{
+    idmap_t map;
+    int *pending;           /* id being realloc'd by each thread */
+    unsigned max_tid = 0;
+    traceop_t op;
+    tf_state_t st = {0, 0, 1};
+    unsigned char buf[TF_MAXOPBYTES];
+    unsigned long long last = 0;
+    size_t i;
+    int id;
+
+    for (i = 0; i < n; i++)
+	if (recs[i].tid > max_tid)
+	    max_tid = recs[i].tid;
+    pending = malloc((max_tid + 1) * sizeof(int));
+    idmap_init(&map);
+    hdr->num_ids = hdr->num_ops = 0;
+
+    for (i = 0; i < n; i++) {
+	rec_t *r = &recs[i];
+
+	switch (r->type) {
+	case R_ALLOC:
+	    op.type = ALLOC;
+	    op.index = hdr->num_ids++;
+	    op.size = r->size;
+	    idmap_put(&map, r->ptr, op.index);
+	    break;
+	case R_FREE:
+	    if ((id = idmap_take(&map, r->ptr)) < 0)
+		continue;   /* allocated before recording started */
+	    op.type = FREE;
+	    op.index = id;
+	    op.size = 0;
+	    break;
+	case R_RBEGIN:
+	    pending[r->tid] = idmap_take(&map, r->ptr);
+	    continue;
+	case R_REND:
+	    op.size = r->size;
+	    if ((op.index = pending[r->tid]) < 0) {
+		op.type = ALLOC;
+		op.index = hdr->num_ids++;
+	    }
+	    else
+		op.type = REALLOC;
+	    idmap_put(&map, r->ptr, op.index);
+	    break;
+	case R_RFAIL:
+	    /* the block keeps its id and size; there is no request */
+	    if (pending[r->tid] >= 0)
+		idmap_put(&map, r->ptr, pending[r->tid]);
+	    continue;
+	default:
+	    continue;
+	}
+	if (last == 0 || r->ns <= last)
+	    op.gap = 0;
+	else if (r->ns - last > UINT_MAX)
+	    op.gap = UINT_MAX;
+	else
+	    op.gap = r->ns - last;
+	if (r->ns > last)
+	    last = r->ns;
+	hdr->num_ops++;
+	if (out == NULL)
+	    continue;
+	if (binary)
+	    fwrite(buf, 1, tf_encode_op(buf, &op, &st), out);
+	else
+	    tf_write_text_op(out, &op);
+    }
+    free(pending);
+    free(map.keys);
+    free(map.ids);
+}
+
+/*
+ * record_finish - library destructor: stop recording and convert the
+ *     raw records into the trace
+ */
+__attribute__((destructor))
+static void record_finish(void)
+{
+    tbuf_t *b;
+    struct stat sb;
+    rec_t *recs;
+    size_t n, len;
+    FILE *out;
+    tf_header_t hdr;
+    unsigned char hbuf[TF_HDRSIZE];
+    int binary, fd;
+
+    if (!recording || getpid() != owner)
+	return;
+    /* stop the other threads appending before taking their buffers */
+    busy = 1;
+    __atomic_store_n(&recording, 0, __ATOMIC_RELEASE);
+    for (b = __atomic_load_n(&all_bufs, __ATOMIC_ACQUIRE); b != NULL; 
+	 b = b->next)
+	flush(b);
+
+    /* Sort a private copy of the raw records into global order */
+    if (fstat(raw_fd, &sb) < 0 || (n = sb.st_size / sizeof(rec_t)) == 0) {
+	close(raw_fd);
+	unlink(raw_path);
+	return;
+    }
+    close(raw_fd);
+    if ((fd = open(raw_path, O_RDONLY)) < 0) {
+	perror(raw_path);
+	return;
+    }
+    recs = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (recs == MAP_FAILED) {
+	perror(raw_path);
+	return;
+    }
+    qsort(recs, n, sizeof(rec_t), cmp_seq);
+
+    /* Count the ids and requests, then write the trace */
+    len = strlen(trace_path);
+    binary = (len > 4 && !strcmp(trace_path + len - 4, ".bin"));
+    hdr.sugg_heapsize = 0;
+    hdr.weight = 1;
+    hdr.flags = TF_FLAG_TIMED;
+    emit(recs, n, binary, NULL, &hdr);
+    if ((out = fopen(trace_path, "w")) == NULL) {
+	perror(trace_path);
+	return;
+    }
+    if (binary) {
+	tf_put_header(hbuf, &hdr);
+	fwrite(hbuf, 1, TF_HDRSIZE, out);
+    }
+    else
+	tf_write_text_header(out, &hdr);
+    emit(recs, n, binary, out, &hdr);
+    fclose(out);
+    munmap(recs, sb.st_size);
+    unlink(raw_path);
+}
@@ -0,0 +1,61 @@
+/*
+ * replay.c - time the mm package on a trace compiled to C by tracec.
+ *     The compiled trace calls mm directly, one statement per request,
+ *     so unlike mdriver's replay loop there is nothing to time but the
+ *     allocator (and the calls into it).
+ *
+ *     usage: make replay TRACE=<trace>; ./replay
+ *
+ * The trace is not checked: run it through mdriver first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mm.h"
+#include "arena.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+/* Defined by the compiled trace */
+extern const int trace_num_ids;
+extern const int trace_num_ops;
+extern const int trace_uses_arena;
+void trace_replay(char **b, mm_arena_t *a);
+
+int verbose = 0;        /* read by fsecs */
+static char **blocks;   /* the block of each id */
+
+/*
+ * run - used by fsecs to replay the compiled trace on an empty heap
+ */
+static void run(void *ptr)
+{
+    mm_arena_t *arena = NULL;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+	fprintf(stderr, "mm_init failed\n");
+	exit(1);
+    }
+    if (trace_uses_arena && (arena = mm_arena_create(0)) == NULL) {
+	fprintf(stderr, "mm_arena_create failed\n");
+	exit(1);
+    }
+    trace_replay(blocks, arena);
+}
+
+int main(int argc, char **argv)
+{
+    double secs;
+
+    if ((blocks = calloc(trace_num_ids + 1, sizeof(char *))) == NULL) {
+	fprintf(stderr, "calloc failed\n");
+	exit(1);
+    }
+    mem_init();
+    init_fsecs();
+    secs = fsecs(run, NULL);
+    printf("%d requests in %.6f secs, %.0f Kops\n", trace_num_ops, secs,
+	   (trace_num_ops / 1e3) / secs);
+    return 0;
+}
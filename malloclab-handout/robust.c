@@ -0,0 +1,113 @@
+/*
+ * robust.c - statistically robust timing of a test function.
+ *
+ * Each run is timed on its own. Runs that lie more than ROBUST_OUTLIER
+ * scaled median absolute deviations from the median, such as a run hit
+ * by a page-cache flush or a context switch, are set aside. The
+ * confidence interval of the median of the rest comes from order
+ * statistics, which assumes nothing about the shape of the
+ * distribution. Runs continue until the interval is within ROBUST_CI
+ * of the median, or the run or time budget is spent.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "robust.h"
+#include "config.h"
+
+/* z value of a two-sided 95% confidence interval */
+#define Z95 1.96
+
+/* Scales the MAD to estimate the standard deviation of normal data */
+#define MAD_SCALE 1.4826
+
+/*
+ * now - the current time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * median - median of the n sorted values in v
+ */
+static double median(double *v, int n)
+{
+    return (n % 2) ? v[n/2] : (v[n/2 - 1] + v[n/2]) / 2;
+}
+
+/*
+ * summarize - set aside the outliers among the n samples and fill in r
+ *     from the rest. tmp must have room for n values.
+ */
+static void summarize(const double *samples, int n, double *tmp, robust_t *r)
+{
+    double m, mad, limit;
+    int i, kept, j, k;
+
+    for (i = 0; i < n; i++)
+	tmp[i] = samples[i];
+    qsort(tmp, n, sizeof(double), cmp_double);
+    m = median(tmp, n);
+
+    /* The MAD, floored so that identical runs don't reject everything */
+    for (i = 0; i < n; i++)
+	tmp[i] = fabs(samples[i] - m);
+    qsort(tmp, n, sizeof(double), cmp_double);
+    mad = median(tmp, n);
+    if (mad < m * 1e-3)
+	mad = m * 1e-3;
+    limit = ROBUST_OUTLIER * MAD_SCALE * mad;
+
+    for (i = kept = 0; i < n; i++)
+	if (fabs(samples[i] - m) <= limit)
+	    tmp[kept++] = samples[i];
+    qsort(tmp, kept, sizeof(double), cmp_double);
+
+    /* Ranks bracketing the median with 95% confidence */
+    j = (int)floor((kept - Z95 * sqrt(kept)) / 2);
+    k = (int)ceil((kept + Z95 * sqrt(kept)) / 2) - 1;
+    r->median = median(tmp, kept);
+    r->lo = tmp[(j < 0) ? 0 : j];
+    r->hi = tmp[(k >= kept) ? kept - 1 : k];
+    r->runs = n;
+    r->outliers = n - kept;
+}
+
+/*
+ * robust_secs - time f(argp) until the confidence interval of the
+ *     median running time is narrow enough, and summarize it in r
+ */
+void robust_secs(robust_test_funct f, void *argp, robust_t *r)
+{
+    double samples[ROBUST_MAX_RUNS], tmp[ROBUST_MAX_RUNS];
+    double start, t;
+    int n = 0;
+
+    f(argp);  /* warm up the caches and the heap */
+    start = now();
+    for (;;) {
+	t = now();
+	f(argp);
+	samples[n++] = now() - t;
+	if (n < ROBUST_MIN_RUNS)
+	    continue;
+	summarize(samples, n, tmp, r);
+	if ((r->median - r->lo <= ROBUST_CI * r->median &&
+	     r->hi - r->median <= ROBUST_CI * r->median) ||
+	    n == ROBUST_MAX_RUNS || now() - start > ROBUST_MAX_SECS)
+	    break;
+    }
+}
@@ -0,0 +1,21 @@
+/*
+ * robust.h - a benchmark runner that repeats a test function until the
+ *     median of its running times is known to within a confidence
+ *     interval, ignoring outlying runs.
+ */
+#ifndef __ROBUST_H_
+#define __ROBUST_H_
+
+typedef void (*robust_test_funct)(void *);
+
+/* Summary of the runs of one test function */
+typedef struct {
+    double median;   /* median running time in secs of the kept runs */
+    double lo, hi;   /* 95% confidence interval of the median */
+    int runs;        /* number of timed runs */
+    int outliers;    /* runs ignored as outliers */
+} robust_t;
+
+void robust_secs(robust_test_funct f, void *argp, robust_t *r);
+
+#endif /* __ROBUST_H_ */
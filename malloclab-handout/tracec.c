@@ -0,0 +1,167 @@
+/*
+ * tracec.c - compile a trace (in either format of tracefmt.h) to C.
+ *     Each request becomes a direct call into the mm package, so the
+ *     replay binary built from the output (see replay.c) times the
+ *     allocator with no interpreter around it at all.
+ *
+ *     usage: tracec <trace> <outfile.c>
+ *
+ * The calls are split into functions of CHUNK requests each, since
+ * compilers handle one function of a million statements badly. The
+ * blocks live in an array indexed by id, as in mdriver, and failed
+ * requests are not checked: mdriver -f <trace> does that. The gaps of
+ * a timed trace are dropped, since the replay is closed-loop.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tracefmt.h"
+
+/* Requests per generated function */
+#define CHUNK 1024
+
+/*
+ * unix_error - report a Unix-style error and exit
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * emit_op - write the call that replays op
+ */
+static void emit_op(FILE *out, const traceop_t *op)
+{
+    switch (op->type) {
+    case ALLOC:
+	fprintf(out, "    b[%d] = mm_malloc(%d);\n", op->index, op->size);
+	break;
+    case FREE:
+	fprintf(out, "    mm_free(b[%d]);\n", op->index);
+	break;
+    case REALLOC:
+	fprintf(out, "    b[%d] = mm_realloc(b[%d], %d);\n",
+		op->index, op->index, op->size);
+	break;
+    case ARENA_ALLOC:
+	fprintf(out, "    b[%d] = mm_arena_alloc(a, %d);\n", op->index, op->size);
+	break;
+    case ARENA_RESET:
+	fprintf(out, "    mm_arena_reset(a);\n");
+	break;
+    }
+}
+
+/*
+ * compile - write the requests of the trace held in buf (binary) or
+ *     read from in (text) as C
+ */
+static void compile(FILE *in, unsigned char *buf, size_t len, FILE *out,
+		    char *inname)
+{
+    tf_header_t hdr;
+    tf_state_t st = {0, 0};
+    traceop_t op;
+    const unsigned char *pos = NULL;
+    int i, rc, num_ids = 0, uses_arena = 0;
+
+    if (buf != NULL) {
+	if (!tf_get_header(buf, len, &hdr)) {
+	    fprintf(stderr, "%s: unsupported binary trace version\n", inname);
+	    exit(1);
+	}
+	st.timed = (hdr.flags & TF_FLAG_TIMED) != 0;
+	pos = buf + TF_HDRSIZE;
+    }
+    else if (!tf_read_text_header(in, &hdr)) {
+	fprintf(stderr, "%s: missing trace header\n", inname);
+	exit(1);
+    }
+
+    fprintf(out, "/*\n * Compiled by tracec from %s. Do not edit.\n */\n",
+	    inname);
+    fprintf(out, "#include \"mm.h\"\n#include \"arena.h\"\n\n");
+    for (i = 0; ; i++) {
+	if (buf == NULL)
+	    rc = tf_read_text_op(in, &op);
+	else if (i == hdr.num_ops)
+	    rc = 0;
+	else
+	    rc = (pos = tf_decode_op(pos, buf + len, &op, &st)) ? 1 : -1;
+	if (rc < 0) {
+	    fprintf(stderr, "%s: bogus request after %d requests\n", inname, i);
+	    exit(1);
+	}
+	if (rc == 0)
+	    break;
+	if (i % CHUNK == 0) {
+	    if (i > 0)
+		fprintf(out, "}\n\n");
+	    fprintf(out, "static void part%d(char **b, mm_arena_t *a)\n{\n",
+		    i / CHUNK);
+	}
+	emit_op(out, &op);
+	if (op.type == ARENA_ALLOC || op.type == ARENA_RESET)
+	    uses_arena = 1;
+	if (op.type != ARENA_RESET && op.index >= num_ids)
+	    num_ids = op.index + 1;
+    }
+    if (i > 0)
+	fprintf(out, "}\n\n");
+
+    fprintf(out, "const int trace_num_ids = %d;\n", num_ids);
+    fprintf(out, "const int trace_num_ops = %d;\n", i);
+    fprintf(out, "const int trace_uses_arena = %d;\n\n", uses_arena);
+    fprintf(out, "void trace_replay(char **b, mm_arena_t *a)\n{\n");
+    for (rc = 0; rc * CHUNK < i; rc++)
+	fprintf(out, "    part%d(b, a);\n", rc);
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    unsigned char *buf;
+    size_t len;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s <trace> <outfile.c>\n", argv[0]);
+	fprintf(stderr, "Compiles a trace to C, for the replay program\n");
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "rb")) == NULL)
+	unix_error(argv[1]);
+    if ((out = fopen(argv[2], "w")) == NULL)
+	unix_error(argv[2]);
+
+    /* peek at the magic string to pick the format */
+    if ((buf = malloc(TF_HDRSIZE)) == NULL)
+	unix_error("malloc failed");
+    len = fread(buf, 1, TF_HDRSIZE, in);
+    if (!tf_is_binary(buf, len)) {
+	rewind(in);
+	free(buf);
+	buf = NULL;
+    }
+    else {
+	/* slurp the rest of the file */
+	size_t cap = TF_HDRSIZE, n;
+	do {
+	    cap *= 2;
+	    if ((buf = realloc(buf, cap)) == NULL)
+		unix_error("realloc failed");
+	    n = fread(buf + len, 1, cap - len, in);
+	    len += n;
+	} while (len == cap);
+    }
+    compile(in, buf, len, out, argv[1]);
+    free(buf);
+    fclose(in);
+    if (fclose(out) != 0)
+	unix_error(argv[2]);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * tracecvt.c - convert traces between the .rep text format and the
+ *     binary format in tracefmt.h. The direction is chosen by looking
+ *     at the input file.
+ *
+ *     usage: tracecvt <infile> <outfile>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tracefmt.h"
+
+/*
+ * unix_error - report a Unix-style error and exit
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * text_to_binary - encode the .rep requests in in as a binary trace
+ */
+static void text_to_binary(FILE *in, FILE *out, char *inname)
+{
+    tf_header_t hdr;
+    tf_state_t st = {0, 0};
+    traceop_t op;
+    unsigned char buf[TF_HDRSIZE > TF_MAXOPBYTES ? TF_HDRSIZE : TF_MAXOPBYTES];
+    int rc, num_ops = 0, num_ids = 0;
+    long start;
+
+    if (!tf_read_text_header(in, &hdr)) {
+	fprintf(stderr, "%s: missing trace header\n", inname);
+	exit(1);
+    }
+
+    /* the trace is timed if any request has a gap: look ahead for one */
+    start = ftell(in);
+    while (tf_read_text_op(in, &op) > 0)
+	if (op.gap > 0) {
+	    hdr.flags |= TF_FLAG_TIMED;
+	    st.timed = 1;
+	    break;
+	}
+    if (fseek(in, start, SEEK_SET) < 0)
+	unix_error("rewinding input failed");
+
+    /* the header is rewritten with the real counts at the end */
+    tf_put_header(buf, &hdr);
+    fwrite(buf, 1, TF_HDRSIZE, out);
+    while ((rc = tf_read_text_op(in, &op)) > 0) {
+	fwrite(buf, 1, tf_encode_op(buf, &op, &st), out);
+	if (op.type == ARENA_ALLOC || op.type == ARENA_RESET)
+	    hdr.flags |= TF_FLAG_ARENA;
+	if (op.type != ARENA_RESET && op.index >= num_ids)
+	    num_ids = op.index + 1;
+	num_ops++;
+    }
+    if (rc < 0) {
+	fprintf(stderr, "%s: bogus request after %d requests\n", inname, num_ops);
+	exit(1);
+    }
+    if (num_ops != hdr.num_ops)
+	fprintf(stderr, "%s: header says %d requests, found %d\n", 
+		inname, hdr.num_ops, num_ops);
+    hdr.num_ops = num_ops;
+    hdr.num_ids = num_ids;
+    tf_put_header(buf, &hdr);
+    if (fseek(out, 0, SEEK_SET) < 0 || fwrite(buf, 1, TF_HDRSIZE, out) != TF_HDRSIZE)
+	unix_error("rewriting header failed");
+}
+
+/*
+ * binary_to_text - decode the binary trace held in buf as .rep text
+ */
+static void binary_to_text(unsigned char *buf, size_t len, FILE *out, char *inname)
+{
+    tf_header_t hdr;
+    tf_state_t st = {0, 0};
+    traceop_t op;
+    const unsigned char *pos = buf + TF_HDRSIZE;
+    int i;
+
+    if (!tf_get_header(buf, len, &hdr)) {
+	fprintf(stderr, "%s: unsupported binary trace version\n", inname);
+	exit(1);
+    }
+    st.timed = (hdr.flags & TF_FLAG_TIMED) != 0;
+    tf_write_text_header(out, &hdr);
+    for (i = 0; i < hdr.num_ops; i++) {
+	if ((pos = tf_decode_op(pos, buf + len, &op, &st)) == NULL) {
+	    fprintf(stderr, "%s: truncated after %d requests\n", inname, i);
+	    exit(1);
+	}
+	tf_write_text_op(out, &op);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    unsigned char *buf;
+    size_t len;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s <infile> <outfile>\n", argv[0]);
+	fprintf(stderr, "Converts a .rep trace to binary, or a binary trace to .rep\n");
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "rb")) == NULL)
+	unix_error(argv[1]);
+    if ((out = fopen(argv[2], "wb")) == NULL)
+	unix_error(argv[2]);
+
+    /* peek at the magic string to pick the direction */
+    if ((buf = malloc(TF_HDRSIZE)) == NULL)
+	unix_error("malloc failed");
+    len = fread(buf, 1, TF_HDRSIZE, in);
+    if (!tf_is_binary(buf, len)) {
+	rewind(in);
+	text_to_binary(in, out, argv[1]);
+    }
+    else {
+	/* slurp the rest of the file */
+	size_t cap = TF_HDRSIZE, n;
+	do {
+	    cap *= 2;
+	    if ((buf = realloc(buf, cap)) == NULL)
+		unix_error("realloc failed");
+	    n = fread(buf + len, 1, cap - len, in);
+	    len += n;
+	} while (len == cap);
+	binary_to_text(buf, len, out, argv[1]);
+    }
+    free(buf);
+    fclose(in);
+    if (fclose(out) != 0)
+	unix_error(argv[2]);
+    return 0;
+}
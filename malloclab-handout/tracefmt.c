@@ -0,0 +1,281 @@
+/*
+ * tracefmt.c - encoding and decoding of trace requests.
+ *
+ * Binary request encoding. Each request starts with a tag byte whose low
+ * 3 bits are the request type. Ids are encoded as the zigzag difference
+ * from the previous request's id; if it is below 31 it is stored in the
+ * upper 5 bits of the tag, otherwise those bits are 31 and a varint
+ * follows. Sized requests are followed by the zigzag difference from the
+ * previous request's size as a varint. Varints use 7 bits per byte, low
+ * bits first, with the high bit set on every byte but the last.
+ * ARENA_RESET carries no id, so its tag is the type alone. In timed
+ * traces (TF_FLAG_TIMED) every request ends with its gap as a varint.
+ *
+ * Text request lines may be preceded by "w <ns>" lines, which give the
+ * gap of the next request; several add up.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "tracefmt.h"
+
+/* Requests whose id delta does not fit in the tag use this marker */
+#define TF_DELTA_ESC 31
+
+/* Map small signed numbers to small unsigned ones and back */
+#define ZIGZAG(x)   (((unsigned)(x) << 1) ^ (unsigned)((x) >> 31))
+#define UNZIGZAG(u) ((int)((u) >> 1) ^ -(int)((u) & 1))
+
+/* Does the request carry a size? */
+#define HAS_SIZE(t) ((t) == ALLOC || (t) == REALLOC || (t) == ARENA_ALLOC)
+
+/*
+ * put32/get32 - store and load little-endian 32 bit words
+ */
+static void put32(unsigned char *buf, unsigned v)
+{
+    buf[0] = v; buf[1] = v >> 8; buf[2] = v >> 16; buf[3] = v >> 24;
+}
+
+static unsigned get32(const unsigned char *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned)buf[3] << 24);
+}
+
+/*
+ * put_varint - store v as a varint and return the number of bytes used
+ */
+static int put_varint(unsigned char *buf, unsigned v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+	buf[n++] = (v & 0x7F) | 0x80;
+	v >>= 7;
+    }
+    buf[n++] = v;
+    return n;
+}
+
+/*
+ * get_varint - load a varint at pos into *v and return the position
+ *     after it, or NULL if it runs past end
+ */
+static const unsigned char *get_varint(const unsigned char *pos, 
+				       const unsigned char *end, unsigned *v)
+{
+    unsigned result = 0;
+    int shift = 0;
+
+    while (pos < end && shift < 35) {
+	result |= (unsigned)(*pos & 0x7F) << shift;
+	if (!(*pos++ & 0x80)) {
+	    *v = result;
+	    return pos;
+	}
+	shift += 7;
+    }
+    return NULL;
+}
+
+/*
+ * tf_is_binary - does the file starting with these len bytes hold a
+ *     binary trace?
+ */
+int tf_is_binary(const unsigned char *buf, size_t len)
+{
+    return len >= TF_HDRSIZE && !memcmp(buf, TF_MAGIC, 8);
+}
+
+/*
+ * tf_put_header - write the TF_HDRSIZE byte binary header into buf
+ */
+void tf_put_header(unsigned char *buf, const tf_header_t *hdr)
+{
+    memcpy(buf, TF_MAGIC, 8);
+    put32(buf + 8, TF_VERSION);
+    put32(buf + 12, hdr->flags);
+    put32(buf + 16, hdr->sugg_heapsize);
+    put32(buf + 20, hdr->num_ids);
+    put32(buf + 24, hdr->num_ops);
+    put32(buf + 28, hdr->weight);
+}
+
+/*
+ * tf_get_header - read the binary header in buf. Returns 0 if it is
+ *     not a binary trace of a version we understand.
+ */
+int tf_get_header(const unsigned char *buf, size_t len, tf_header_t *hdr)
+{
+    if (!tf_is_binary(buf, len) || get32(buf + 8) != TF_VERSION)
+	return 0;
+    hdr->flags = get32(buf + 12);
+    hdr->sugg_heapsize = get32(buf + 16);
+    hdr->num_ids = get32(buf + 20);
+    hdr->num_ops = get32(buf + 24);
+    hdr->weight = get32(buf + 28);
+    return 1;
+}
+
+/*
+ * tf_encode_op - encode op into buf, which must have room for
+ *     TF_MAXOPBYTES, and return the number of bytes used
+ */
+int tf_encode_op(unsigned char *buf, const traceop_t *op, tf_state_t *st)
+{
+    unsigned delta;
+    int n = 1;
+
+    if (op->type == ARENA_RESET)
+	buf[0] = op->type;
+    else {
+	delta = ZIGZAG(op->index - st->index);
+	st->index = op->index;
+	if (delta < TF_DELTA_ESC)
+	    buf[0] = op->type | (delta << 3);
+	else {
+	    buf[0] = op->type | (TF_DELTA_ESC << 3);
+	    n += put_varint(buf + n, delta);
+	}
+	if (HAS_SIZE(op->type)) {
+	    n += put_varint(buf + n, ZIGZAG(op->size - st->size));
+	    st->size = op->size;
+	}
+    }
+    if (st->timed)
+	n += put_varint(buf + n, op->gap);
+    return n;
+}
+
+/*
+ * tf_decode_op - decode the request at pos into op and return the
+ *     position of the next one, or NULL if the request is malformed or
+ *     runs past end
+ */
+const unsigned char *tf_decode_op(const unsigned char *pos, 
+				  const unsigned char *end,
+				  traceop_t *op, tf_state_t *st)
+{
+    unsigned tag, delta;
+
+    if (pos >= end)
+	return NULL;
+    tag = *pos++;
+    op->type = tag & 0x7;
+    if (op->type > ARENA_RESET)
+	return NULL;
+    if (op->type == ARENA_RESET)
+	op->index = 0;
+    else {
+	delta = tag >> 3;
+	if (delta == TF_DELTA_ESC && 
+	    (pos = get_varint(pos, end, &delta)) == NULL)
+	    return NULL;
+	op->index = st->index += UNZIGZAG(delta);
+	if (HAS_SIZE(op->type)) {
+	    if ((pos = get_varint(pos, end, &delta)) == NULL)
+		return NULL;
+	    op->size = st->size += UNZIGZAG(delta);
+	}
+    }
+    op->gap = 0;
+    if (st->timed && (pos = get_varint(pos, end, &op->gap)) == NULL)
+	return NULL;
+    return pos;
+}
+
+/*
+ * tf_read_text_header - read the four header lines of a .rep file.
+ *     Returns 0 if they are missing.
+ */
+int tf_read_text_header(FILE *f, tf_header_t *hdr)
+{
+    hdr->flags = 0;
+    return fscanf(f, "%d %d %d %d", &hdr->sugg_heapsize, &hdr->num_ids,
+		  &hdr->num_ops, &hdr->weight) == 4;
+}
+
+/*
+ * tf_read_text_op - read the next request line of a .rep file into op,
+ *     with the gap of the "w" lines before it. Returns 1 on success, 0
+ *     at the end of the file and -1 if the request type is bogus.
+ */
+int tf_read_text_op(FILE *f, traceop_t *op)
+{
+    char type[2];
+    unsigned index = 0, size = 0, wait;
+
+    op->gap = 0;
+    for (;;) {
+	if (fscanf(f, "%1s", type) != 1)
+	    return 0;
+	if (type[0] != 'w')
+	    break;
+	wait = 0;
+	fscanf(f, "%u", &wait);
+	op->gap = (op->gap > UINT_MAX - wait) ? UINT_MAX : op->gap + wait;
+    }
+    switch (type[0]) {
+    case 'a':
+	op->type = ALLOC;
+	fscanf(f, "%u %u", &index, &size);
+	break;
+    case 'r':
+	op->type = REALLOC;
+	fscanf(f, "%u %u", &index, &size);
+	break;
+    case 'f':
+	op->type = FREE;
+	fscanf(f, "%u", &index);
+	break;
+    case 'b': /* bump allocation from the trace's arena */
+	op->type = ARENA_ALLOC;
+	fscanf(f, "%u %u", &index, &size);
+	break;
+    case 'x': /* reset the arena, freeing all of its blocks */
+	op->type = ARENA_RESET;
+	break;
+    default:
+	return -1;
+    }
+    op->index = index;
+    op->size = size;
+    return 1;
+}
+
+/*
+ * tf_write_text_header - write the four header lines of a .rep file
+ */
+void tf_write_text_header(FILE *f, const tf_header_t *hdr)
+{
+    fprintf(f, "%d\n%d\n%d\n%d\n", hdr->sugg_heapsize, hdr->num_ids,
+	    hdr->num_ops, hdr->weight);
+}
+
+/*
+ * tf_write_text_op - write op as a .rep request line, after a "w" line
+ *     if it has a gap
+ */
+void tf_write_text_op(FILE *f, const traceop_t *op)
+{
+    if (op->gap > 0)
+	fprintf(f, "w %u\n", op->gap);
+    switch (op->type) {
+    case ALLOC:
+	fprintf(f, "a %d %d\n", op->index, op->size);
+	break;
+    case REALLOC:
+	fprintf(f, "r %d %d\n", op->index, op->size);
+	break;
+    case FREE:
+	fprintf(f, "f %d\n", op->index);
+	break;
+    case ARENA_ALLOC:
+	fprintf(f, "b %d %d\n", op->index, op->size);
+	break;
+    case ARENA_RESET:
+	fprintf(f, "x\n");
+	break;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * tracefmt.h - the allocator request type and the two on-disk trace
+ *     formats: the original .rep text format and a compact binary format
+ *     that the driver can replay straight out of an mmap'd file.
+ */
+#include <stdio.h>
+
+#ifndef __TRACEFMT_H_
+#define __TRACEFMT_H_
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC,       /* type of request */
+	  ARENA_ALLOC, ARENA_RESET} type;
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    unsigned gap;                     /* ns since the previous request
+					 arrived, or 0 if untimed */
+} traceop_t;
+
+/* The four header fields shared by both formats */
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int flags;           /* TF_FLAG_xxx bits (binary traces only) */
+} tf_header_t;
+
+/* The trace contains arena requests */
+#define TF_FLAG_ARENA 0x1
+
+/* Every request carries its gap, the time since the previous arrival */
+#define TF_FLAG_TIMED 0x2
+
+/* 
+ * Binary traces start with a TF_HDRSIZE byte header: the 8 byte magic
+ * string, then little-endian 32 bit version, flags and the four
+ * tf_header_t fields. The requests follow, each encoded in at most
+ * TF_MAXOPBYTES bytes (see tracefmt.c).
+ */
+#define TF_MAGIC "MMTRACE1"
+#define TF_VERSION 1
+#define TF_HDRSIZE 32
+#define TF_MAXOPBYTES 16
+
+/* Running state of the binary encoder and decoder */
+typedef struct {
+    int index;           /* id of the previous request */
+    int size;            /* size of the previous sized request */
+    int timed;           /* are gaps encoded? (TF_FLAG_TIMED) */
+} tf_state_t;
+
+/* Binary format */
+int tf_is_binary(const unsigned char *buf, size_t len);
+void tf_put_header(unsigned char *buf, const tf_header_t *hdr);
+int tf_get_header(const unsigned char *buf, size_t len, tf_header_t *hdr);
+int tf_encode_op(unsigned char *buf, const traceop_t *op, tf_state_t *st);
+const unsigned char *tf_decode_op(const unsigned char *pos, 
+				  const unsigned char *end,
+				  traceop_t *op, tf_state_t *st);
+
+/* Text (.rep) format */
+int tf_read_text_header(FILE *f, tf_header_t *hdr);
+int tf_read_text_op(FILE *f, traceop_t *op);
+void tf_write_text_header(FILE *f, const tf_header_t *hdr);
+void tf_write_text_op(FILE *f, const traceop_t *op);
+
+#endif /* __TRACEFMT_H_ */
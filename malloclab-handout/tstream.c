@@ -0,0 +1,321 @@
+/*
+ * tstream.c - streaming reader for text and binary traces.
+ *
+ * A reader thread decodes requests into one of two buffers of chunk_ops
+ * requests while the driver drains the other. The two sides hand the
+ * buffers back and forth under a mutex, so the cost of reading and
+ * parsing the file overlaps with the replay and memory use is bounded
+ * by the two buffers, whatever the length of the trace. Each pass over
+ * the trace (tstream_rewind) restarts the reader at the first request.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "tstream.h"
+
+/* Bytes of the binary file read at a time */
+#define TS_RAWSIZE (256*(1<<10))
+
+/* What follows the requests in a buffer */
+#define TS_MORE  0   /* more requests in the next buffer */
+#define TS_END   1   /* the end of the trace */
+#define TS_ERROR 2   /* a malformed or truncated request */
+
+/* One of the two read-ahead buffers */
+typedef struct {
+    traceop_t *ops;         /* decoded requests */
+    int count;              /* number of requests in ops */
+    int status;             /* TS_xxx after the last request in ops */
+    int full;               /* filled by the reader and not yet drained */
+} tbuf_t;
+
+struct tstream {
+    int fd;                 /* the trace file */
+    FILE *text;             /* stdio stream on fd for .rep traces */
+    long ops_off;           /* file offset of the first request */
+    int num_ops;            /* requests declared in the header, or 0 */
+    int chunk_ops;          /* requests per buffer */
+
+    /* Owned by the reader thread while it runs */
+    long nread;             /* requests decoded so far */
+    unsigned char *raw;     /* binary traces: bytes read from the file... */
+    unsigned char *pos;     /* ... the next undecoded byte... */
+    unsigned char *end;     /* ... and the end of the bytes read */
+    int eof;                /* has the last byte of the file been read? */
+    tf_state_t state;       /* binary decoder state */
+
+    /* Owned by the consumer */
+    int cur;                /* buffer being drained */
+    int next;               /* next request in it */
+    int draining;           /* has cur been handed over by the reader? */
+
+    tbuf_t buf[2];
+    pthread_t reader;
+    int running;            /* is the reader thread started? */
+    int stop;               /* asks the reader to quit early */
+    pthread_mutex_t lock;   /* protects full and stop */
+    pthread_cond_t cond;    /* signals changes to full and stop */
+};
+
+/*
+ * refill - move the undecoded bytes of a binary trace to the front of
+ *     s->raw and read as much of the file after them as fits
+ */
+static int refill(tstream_t *s)
+{
+    size_t left = s->end - s->pos;
+    ssize_t n;
+
+    memmove(s->raw, s->pos, left);
+    s->pos = s->raw;
+    s->end = s->raw + left;
+    while (!s->eof && s->end < s->raw + TS_RAWSIZE) {
+	if ((n = read(s->fd, s->end, s->raw + TS_RAWSIZE - s->end)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (n == 0)
+	    s->eof = 1;
+	s->end += n;
+    }
+    return 0;
+}
+
+/*
+ * fill_binary - decode up to chunk_ops requests of a binary trace into b
+ */
+static int fill_binary(tstream_t *s, tbuf_t *b)
+{
+    unsigned char *pos;
+
+    for (b->count = 0; b->count < s->chunk_ops; b->count++, s->nread++) {
+	if (s->num_ops > 0 && s->nread == s->num_ops)
+	    return TS_END;
+	if (s->end - s->pos < TF_MAXOPBYTES && !s->eof && refill(s) < 0)
+	    return TS_ERROR;
+	if (s->pos == s->end)
+	    return (s->num_ops > 0) ? TS_ERROR : TS_END;
+	pos = (unsigned char *)tf_decode_op(s->pos, s->end,
+					    &b->ops[b->count], &s->state);
+	if (pos == NULL)
+	    return TS_ERROR;
+	s->pos = pos;
+    }
+    return TS_MORE;
+}
+
+/*
+ * fill_text - parse up to chunk_ops requests of a .rep trace into b
+ */
+static int fill_text(tstream_t *s, tbuf_t *b)
+{
+    int rc;
+
+    for (b->count = 0; b->count < s->chunk_ops; b->count++, s->nread++) {
+	if (s->num_ops > 0 && s->nread == s->num_ops)
+	    return TS_END;
+	if ((rc = tf_read_text_op(s->text, &b->ops[b->count])) < 0)
+	    return TS_ERROR;
+	if (rc == 0)
+	    return (s->num_ops > 0) ? TS_ERROR : TS_END;
+    }
+    return TS_MORE;
+}
+
+/*
+ * reader - the read-ahead thread. Fills the two buffers alternately,
+ *     waiting for the consumer to drain each one before refilling it.
+ */
+static void *reader(void *arg)
+{
+    tstream_t *s = arg;
+    tbuf_t *b;
+    int i = 0, status;
+
+    do {
+	b = &s->buf[i];
+	pthread_mutex_lock(&s->lock);
+	while (b->full && !s->stop)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	if (s->stop) {
+	    pthread_mutex_unlock(&s->lock);
+	    break;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	status = (s->text == NULL) ? fill_binary(s, b) : fill_text(s, b);
+
+	pthread_mutex_lock(&s->lock);
+	b->status = status;
+	b->full = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	i ^= 1;
+    } while (status == TS_MORE);
+    return NULL;
+}
+
+/*
+ * stop_reader - stop the reader thread, if it is running, and wait
+ *     for it to exit
+ */
+static void stop_reader(tstream_t *s)
+{
+    if (!s->running)
+	return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+    s->running = 0;
+}
+
+/*
+ * tstream_open - open the trace at path, which may be in either format,
+ *     and read its header into hdr. The num_ops and num_ids fields are
+ *     only hints here: a trace may declare them as 0, in which case it
+ *     ends at the end of the file. Since a text trace does not say
+ *     whether it has arena requests or gaps, text traces report
+ *     TF_FLAG_ARENA and TF_FLAG_TIMED.
+ *     Returns NULL if the file cannot be opened or has a bad header.
+ */
+tstream_t *tstream_open(const char *path, int chunk_ops, tf_header_t *hdr)
+{
+    tstream_t *s;
+    unsigned char magic[TF_HDRSIZE];
+    ssize_t n;
+    size_t len = 0;
+
+    if ((s = calloc(1, sizeof(tstream_t))) == NULL)
+	return NULL;
+    if ((s->fd = open(path, O_RDONLY)) < 0) {
+	free(s);
+	return NULL;
+    }
+    while (len < TF_HDRSIZE && (n = read(s->fd, magic + len,
+					 TF_HDRSIZE - len)) > 0)
+	len += n;
+
+    if (tf_is_binary(magic, len)) {
+	if (!tf_get_header(magic, len, hdr) ||
+	    (s->raw = malloc(TS_RAWSIZE)) == NULL)
+	    goto fail;
+	s->state.timed = (hdr->flags & TF_FLAG_TIMED) != 0;
+	s->ops_off = TF_HDRSIZE;
+    }
+    else {
+	if (lseek(s->fd, 0, SEEK_SET) < 0 ||
+	    (s->text = fdopen(s->fd, "r")) == NULL)
+	    goto fail;
+	if (!tf_read_text_header(s->text, hdr))
+	    goto fail;
+	hdr->flags |= TF_FLAG_ARENA | TF_FLAG_TIMED;
+	s->ops_off = ftell(s->text);
+    }
+    s->num_ops = hdr->num_ops;
+    s->chunk_ops = chunk_ops;
+    if ((s->buf[0].ops = malloc(chunk_ops * sizeof(traceop_t))) == NULL ||
+	(s->buf[1].ops = malloc(chunk_ops * sizeof(traceop_t))) == NULL)
+	goto fail;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    return s;
+
+ fail:
+    if (s->text != NULL)
+	fclose(s->text);
+    else
+	close(s->fd);
+    free(s->raw);
+    free(s->buf[0].ops);
+    free(s);
+    return NULL;
+}
+
+/*
+ * tstream_rewind - start a new pass at the first request of the trace,
+ *     abandoning the current pass if it is unfinished. Returns 0 on
+ *     success and -1 if the file cannot be rewound.
+ */
+int tstream_rewind(tstream_t *s)
+{
+    stop_reader(s);
+
+    if (s->text == NULL) {
+	if (lseek(s->fd, s->ops_off, SEEK_SET) < 0)
+	    return -1;
+	s->pos = s->end = s->raw;
+	s->eof = 0;
+	s->state.index = 0;
+	s->state.size = 0;
+    }
+    else if (fseek(s->text, s->ops_off, SEEK_SET) < 0)
+	return -1;
+
+    s->nread = 0;
+    s->cur = s->next = s->draining = 0;
+    s->buf[0].full = s->buf[1].full = 0;
+    s->stop = 0;
+    if (pthread_create(&s->reader, NULL, reader, s) != 0)
+	return -1;
+    s->running = 1;
+    return 0;
+}
+
+/*
+ * tstream_next - point *op at the next request of the current pass. The
+ *     request stays valid until the next call. Returns 1 on success, 0
+ *     at the end of the trace and -1 if the request is malformed.
+ */
+int tstream_next(tstream_t *s, traceop_t **op)
+{
+    tbuf_t *b = &s->buf[s->cur];
+
+    while (!s->draining || s->next == b->count) {
+	if (s->draining) {
+	    /* b is drained: hand it back and move to the other one */
+	    if (b->status != TS_MORE)
+		return (b->status == TS_END) ? 0 : -1;
+	    pthread_mutex_lock(&s->lock);
+	    b->full = 0;
+	    pthread_cond_broadcast(&s->cond);
+	    pthread_mutex_unlock(&s->lock);
+	    s->cur ^= 1;
+	    b = &s->buf[s->cur];
+	    s->next = 0;
+	    s->draining = 0;
+	}
+	pthread_mutex_lock(&s->lock);
+	while (!b->full)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+	s->draining = 1;
+    }
+    *op = &b->ops[s->next++];
+    return 1;
+}
+
+/*
+ * tstream_close - stop reading and free the stream
+ */
+void tstream_close(tstream_t *s)
+{
+    stop_reader(s);
+    if (s->text != NULL)
+	fclose(s->text);
+    else
+	close(s->fd);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->raw);
+    free(s->buf[0].ops);
+    free(s->buf[1].ops);
+    free(s);
+}
@@ -0,0 +1,19 @@
+/*
+ * tstream.h - streaming reader for text and binary traces. Requests are
+ *     decoded in fixed-size chunks by a read-ahead thread into two
+ *     alternating buffers, so a trace of any length is replayed in
+ *     bounded memory.
+ */
+#include "tracefmt.h"
+
+#ifndef __TSTREAM_H_
+#define __TSTREAM_H_
+
+typedef struct tstream tstream_t;
+
+tstream_t *tstream_open(const char *path, int chunk_ops, tf_header_t *hdr);
+int tstream_rewind(tstream_t *s);
+int tstream_next(tstream_t *s, traceop_t **op);
+void tstream_close(tstream_t *s);
+
+#endif /* __TSTREAM_H_ */